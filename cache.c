@@ -7,11 +7,14 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
 
 #include "cache.h"
 #include "main.h"
+#include "results.h"
 
 /* cache configuration parameters */
 static int cache_split = 0;
@@ -19,10 +22,17 @@ static int cache_usize = DEFAULT_CACHE_SIZE;
 static int cache_isize = DEFAULT_CACHE_SIZE; 
 static int cache_dsize = DEFAULT_CACHE_SIZE;
 static int cache_block_size = DEFAULT_CACHE_BLOCK_SIZE;
-static int words_per_block = DEFAULT_CACHE_BLOCK_SIZE / WORD_SIZE;
+static int cache_word_size = DEFAULT_WORD_SIZE;
+static int cache_sub_block_size = DEFAULT_CACHE_SUB_BLOCK_SIZE;
+static int words_per_block = DEFAULT_CACHE_BLOCK_SIZE / DEFAULT_WORD_SIZE;
+static int words_per_sub_block = DEFAULT_CACHE_BLOCK_SIZE / DEFAULT_WORD_SIZE;
+static int sub_block_size = DEFAULT_CACHE_BLOCK_SIZE;	/* as initialized */
 static int cache_assoc = DEFAULT_CACHE_ASSOC;
 static int cache_writeback = DEFAULT_CACHE_WRITEBACK;
 static int cache_writealloc = DEFAULT_CACHE_WRITEALLOC;
+static int cache_index_fn = DEFAULT_CACHE_INDEX;
+static int cache_victim_size = DEFAULT_VICTIM_CACHE_SIZE;
+static int cache_write_buffer_size = DEFAULT_WRITE_BUFFER_SIZE;
 
 /* cache model data structures */
 static Pcache icache;
@@ -31,6 +41,30 @@ static cache c1;
 static cache c2;
 static cache_stat cache_stat_inst;
 static cache_stat cache_stat_data;
+static write_buffer wbuf;
+static write_buffer_stat wbuf_stat;
+static unsigned lru_clock = 0;		/* access time for skewed LRU */
+
+/* statistics kept in the result store, in column order */
+static stat_entry cache_stat_table[] = {
+  { "inst_accesses", &cache_stat_inst.accesses },
+  { "inst_misses", &cache_stat_inst.misses },
+  { "inst_replacements", &cache_stat_inst.replacements },
+  { "inst_demand_fetches", &cache_stat_inst.demand_fetches },
+  { "inst_copies_back", &cache_stat_inst.copies_back },
+  { "inst_sector_misses", &cache_stat_inst.sector_misses },
+  { "inst_victim_hits", &cache_stat_inst.victim_hits },
+  { "data_accesses", &cache_stat_data.accesses },
+  { "data_misses", &cache_stat_data.misses },
+  { "data_replacements", &cache_stat_data.replacements },
+  { "data_demand_fetches", &cache_stat_data.demand_fetches },
+  { "data_copies_back", &cache_stat_data.copies_back },
+  { "data_sector_misses", &cache_stat_data.sector_misses },
+  { "data_victim_hits", &cache_stat_data.victim_hits },
+  { "wbuf_stores", &wbuf_stat.stores },
+  { "wbuf_merges", &wbuf_stat.merges },
+  { "wbuf_drains", &wbuf_stat.drains },
+};
 
 /************************************************************/
 void set_cache_param(int param, int value)
@@ -38,7 +72,6 @@ void set_cache_param(int param, int value)
   switch (param) {
   case CACHE_PARAM_BLOCK_SIZE:
     cache_block_size = value;
-    words_per_block = value / WORD_SIZE;
     break;
   case CACHE_PARAM_USIZE:
     cache_split = FALSE;
@@ -67,6 +100,21 @@ void set_cache_param(int param, int value)
   case CACHE_PARAM_NOWRITEALLOC:
     cache_writealloc = FALSE;
     break;
+  case CACHE_PARAM_INDEX:
+    cache_index_fn = value;
+    break;
+  case CACHE_PARAM_WORD_SIZE:
+    cache_word_size = value;
+    break;
+  case CACHE_PARAM_SUB_BLOCK_SIZE:
+    cache_sub_block_size = value;
+    break;
+  case CACHE_PARAM_VICTIM_SIZE:
+    cache_victim_size = value;
+    break;
+  case CACHE_PARAM_WRITE_BUFFER_SIZE:
+    cache_write_buffer_size = value;
+    break;
   default:
     printf("error set_cache_param: bad parameter value\n");
     exit(-1);
@@ -76,53 +124,124 @@ void set_cache_param(int param, int value)
 /************************************************************/
 
 /************************************************************/
+int get_cache_param(int param)
+{
+  switch (param) {
+  case CACHE_PARAM_BLOCK_SIZE:
+    return(cache_block_size);
+  case CACHE_PARAM_USIZE:
+    return(cache_usize);
+  case CACHE_PARAM_ASSOC:
+    return(cache_assoc);
+  case CACHE_PARAM_WORD_SIZE:
+    return(cache_word_size);
+  default:
+    printf("error get_cache_param: bad parameter value\n");
+    exit(-1);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+static int largest_prime(int n)
+{
+	int p, d;
+
+	for (p = n; p > 2; p--) {
+		for (d = 2; d * d <= p; d++)
+			if (p % d == 0)
+				break;
+		if (d * d > p)
+			return(p);
+	}
+	return((n < 2) ? 1 : 2);
+}
+
+static void init_one_cache(Pcache c, int size, Pcache shared)
+{
+	int nontag_bits;
+
+	c->size = size;                                              /* cache size */
+	c->associativity = cache_assoc;                              /* cache associativity */
+	c->n_sets = (c->size / cache_block_size) / cache_assoc;      /* number of cache sets */
+	nontag_bits = LOG2(c->n_sets) + LOG2(cache_block_size);
+	c->index_mask = (((2 << nontag_bits) - 1) >> LOG2(cache_block_size)) << LOG2(cache_block_size);/* mask to find cache index */
+	c->index_mask_offset = LOG2(cache_block_size);               /* number of zero bits in mask */
+	c->tag_offset = ceil(LOG2_FL(c->n_sets)) + LOG2(cache_block_size);
+	c->index_fn = cache_index_fn;
+	c->set_bits = ceil(LOG2_FL(c->n_sets));
+	c->n_index_sets = (cache_index_fn == INDEX_PRIME) ? largest_prime(c->n_sets) : c->n_sets;
+
+	if (shared) {
+		c->LRU_head = shared->LRU_head;
+		c->LRU_tail = shared->LRU_tail;
+		c->set_contents = shared->set_contents;
+		c->lines = shared->lines;
+		c->victims = shared->victims;
+		c->n_victims = shared->n_victims;
+		return;
+	}
+
+	c->n_victims = cache_victim_size;
+	if (c->n_victims > 0) {
+		c->victims = (Pcache_line)malloc(sizeof(cache_line)*c->n_victims);
+		memset(c->victims, 0, sizeof(cache_line)*c->n_victims);
+	}
+
+	if (c->index_fn == INDEX_SKEW) {
+		/* every way is indexed separately, so sets have no LRU list */
+		c->lines = (Pcache_line)malloc(sizeof(cache_line)*c->n_sets*cache_assoc);
+		memset(c->lines, 0, sizeof(cache_line)*c->n_sets*cache_assoc);
+	} else {
+		c->LRU_head = (Pcache_line *)malloc(sizeof(Pcache_line)*c->n_sets);
+		c->LRU_tail = (Pcache_line *)malloc(sizeof(Pcache_line)*c->n_sets);
+		memset(c->LRU_head, 0, sizeof(Pcache_line)*c->n_sets);
+		memset(c->LRU_tail, 0, sizeof(Pcache_line)*c->n_sets);
+		c->set_contents = (int *)malloc(sizeof(int)*c->n_sets);
+		memset(c->set_contents, 0, sizeof(int)*c->n_sets);
+	}
+}
+
 void init_cache()
 {
 	/* initialize the cache, and cache statistics data structures */
-	cache_line *line;
-	int i, nontag_bits;
+
+	// sub-blocks default to the whole line
+	sub_block_size = cache_sub_block_size;
+	if (sub_block_size <= 0 || sub_block_size > cache_block_size)
+		sub_block_size = cache_block_size;
+	if (cache_word_size <= 0 || sub_block_size % cache_word_size ||
+	    cache_block_size % sub_block_size ||
+	    cache_block_size / sub_block_size > MAX_SUB_BLOCKS) {
+		printf("error init_cache: block size %d, sub-block size %d and word size %d do not fit\n",
+		       cache_block_size, sub_block_size, cache_word_size);
+		exit(-1);
+	}
+	words_per_block = cache_block_size / cache_word_size;
+	words_per_sub_block = sub_block_size / cache_word_size;
 
 	// I-cache (or united)
-	c1.size =  (cache_split) ? cache_isize : cache_usize;        /* cache size */
-	c1.associativity = cache_assoc;                              /* cache associativity */
-	c1.n_sets = (c1.size / cache_block_size) / cache_assoc;;     /* number of cache sets */
-	nontag_bits = LOG2(c1.n_sets) + LOG2(cache_block_size);
-	c1.index_mask = (((2 << nontag_bits) - 1) >> LOG2(cache_block_size)) << LOG2(cache_block_size);/* mask to find cache index */
-	c1.index_mask_offset = LOG2(cache_block_size);               /* number of zero bits in mask */
-	c1.LRU_head = (Pcache_line *)malloc(sizeof(Pcache_line)*c1.n_sets);
-	c1.LRU_tail = (Pcache_line *)malloc(sizeof(Pcache_line)*c1.n_sets);
-	memset(c1.LRU_head, 0, sizeof(Pcache_line)*c1.n_sets);
-	memset(c1.LRU_tail, 0, sizeof(Pcache_line)*c1.n_sets);
-	c1.set_contents = (int *)malloc(sizeof(int)*c1.n_sets);
-	memset(c1.set_contents, 0, sizeof(int)*c1.n_sets);
+	init_one_cache(&c1, (cache_split) ? cache_isize : cache_usize, NULL);
 
 	// D-cache
-	c2.size = (cache_split) ? cache_dsize : cache_usize;;        /* cache size */
-	c2.associativity = cache_assoc;                              /* cache associativity */
-	c2.n_sets = (c2.size / cache_block_size) / cache_assoc;;     /* number of cache sets */
-	nontag_bits = LOG2(c2.n_sets) + LOG2(cache_block_size);
-	c2.index_mask = (((2 << nontag_bits) - 1) >> LOG2(cache_block_size)) << LOG2(cache_block_size);/* mask to find cache index */
-	c2.index_mask_offset = LOG2(cache_block_size);               /* number of zero bits in mask */
-	if (cache_split) {
-		c2.LRU_head = (Pcache_line *)malloc(sizeof(Pcache_line)*c2.n_sets);
-		c2.LRU_tail = (Pcache_line *)malloc(sizeof(Pcache_line)*c2.n_sets);
-		memset(c2.LRU_head, 0, sizeof(Pcache_line)*c2.n_sets);
-		memset(c2.LRU_tail, 0, sizeof(Pcache_line)*c2.n_sets);
-		c2.set_contents = (int *)malloc(sizeof(int)*c2.n_sets);
-		memset(c2.set_contents, 0, sizeof(int)*c2.n_sets);
-	} else {
-		c2.LRU_head = c1.LRU_head;
-		c2.LRU_tail = c1.LRU_tail;
-		c2.set_contents = c1.set_contents;
+	init_one_cache(&c2, (cache_split) ? cache_dsize : cache_usize,
+		       (cache_split) ? NULL : &c1);
+
+	// write buffer, one entry per block
+	wbuf.size = cache_write_buffer_size;
+	if (wbuf.size > 0) {
+		wbuf.block = (unsigned *)malloc(sizeof(unsigned)*wbuf.size);
+		wbuf.written = (char *)malloc(wbuf.size*words_per_block);
 	}
 }
 /************************************************************/
 
 /************************************************************/
-extern void data_copy_cache2mem(int *dirty, int type);
+extern void data_copy_cache2mem(unsigned *dirty, int type);
+/* fills are one sub-block, the whole line unless sectored */
 void inst_copy_mem2cache(int *old_tag, int new_tag)
 {
-	cache_stat_inst.demand_fetches += (cache_block_size>>2);
+	cache_stat_inst.demand_fetches += words_per_sub_block;
 	*old_tag = new_tag;
 }
 
@@ -131,301 +250,446 @@ void inst_load_hit()
 	// do nothing
 }
 
-void inst_load_miss(int empty, int replace, int old_dirty, int *new_dirty, int *old_tag, int new_tag)
+void inst_load_miss(int empty, int replace, unsigned old_dirty, unsigned *new_dirty, int *old_tag, int new_tag)
 {
 	cache_stat_inst.misses ++;
 	if (!empty) {
 		if (cache_writeback && old_dirty)
-			data_copy_cache2mem(new_dirty, CB_1LINE);
+			data_copy_cache2mem(&old_dirty, CB_1LINE);
 		if (replace)
 			cache_stat_inst.replacements ++;
 	}
 	inst_copy_mem2cache(old_tag, new_tag);
 }
+
+/* the line came back from the victim cache, so nothing is fetched */
+void inst_victim_hit(int replace, int *old_tag, int new_tag)
+{
+	cache_stat_inst.misses ++;
+	cache_stat_inst.victim_hits ++;
+	if (replace)
+		cache_stat_inst.replacements ++;
+	*old_tag = new_tag;
+}
 /************************************************************/
 
 /************************************************************/
 void data_copy_mem2cache(int *old_tag, int new_tag)
 {
-	cache_stat_data.demand_fetches += (cache_block_size>>2);
+	cache_stat_data.demand_fetches += words_per_sub_block;
 	*old_tag = new_tag;
 }
 
-void data_copy_cache2mem(int *dirty, int type)
+static int count_bits(unsigned x)
+{
+	int n;
+
+	for (n = 0; x; x &= x - 1)
+		n ++;
+	return(n);
+}
+
+/* a line write back only copies its dirty sub-blocks */
+void data_copy_cache2mem(unsigned *dirty, int type)
 {
-	int size = (type == CB_1WORD) ? 1 : (cache_block_size>>2);
+	int size = (type == CB_1WORD) ? 1 : count_bits(*dirty) * words_per_sub_block;
 
 	cache_stat_data.copies_back += size;
 	*dirty = 0;
 }
 
+/* drains the oldest write buffer entry as one memory write */
+static void write_buffer_drain()
+{
+	char *written = &wbuf.written[wbuf.head * words_per_block];
+	int i;
+
+	for (i = 0; i < words_per_block; i++)
+		if (written[i])
+			cache_stat_data.copies_back ++;
+	wbuf_stat.drains ++;
+	wbuf.head = (wbuf.head + 1) % wbuf.size;
+	wbuf.count --;
+}
+
+/* a store's word write to memory, combined in the write buffer if any */
+static void data_write_word(unsigned addr)
+{
+	unsigned block = addr / cache_block_size;
+	int word = (addr % cache_block_size) / cache_word_size;
+	unsigned dummy;
+	int i, e;
+
+	if (wbuf.size <= 0) {
+		data_copy_cache2mem(&dummy, CB_1WORD);
+		return;
+	}
+
+	wbuf_stat.stores ++;
+	for (i = 0; i < wbuf.count; i++) {
+		e = (wbuf.head + i) % wbuf.size;
+		if (wbuf.block[e] == block) {
+			wbuf.written[e * words_per_block + word] = 1;
+			wbuf_stat.merges ++;
+			return;
+		}
+	}
+
+	if (wbuf.count == wbuf.size)
+		write_buffer_drain();
+	e = (wbuf.head + wbuf.count) % wbuf.size;
+	wbuf.block[e] = block;
+	memset(&wbuf.written[e * words_per_block], 0, words_per_block);
+	wbuf.written[e * words_per_block + word] = 1;
+	wbuf.count ++;
+}
+
 void data_load_hit()
 {
 	// do nothing
 }
 
-void data_load_miss(int empty, int replace, int old_dirty, int *new_dirty, int *old_tag, int new_tag)
+void data_load_miss(int empty, int replace, unsigned old_dirty, unsigned *new_dirty, int *old_tag, int new_tag)
 {
 	cache_stat_data.misses ++;
 	if (!empty) {
 		if (cache_writeback && old_dirty)
-			data_copy_cache2mem(new_dirty, CB_1LINE);
+			data_copy_cache2mem(&old_dirty, CB_1LINE);
 		if (replace)
 			cache_stat_data.replacements ++;
 	}
 	data_copy_mem2cache(old_tag, new_tag);
 }
 
-void data_write_hit(int *dirty)
+/* the line came back from the victim cache, so nothing is fetched */
+void data_victim_hit(int replace, int *old_tag, int new_tag)
+{
+	cache_stat_data.misses ++;
+	cache_stat_data.victim_hits ++;
+	if (replace)
+		cache_stat_data.replacements ++;
+	*old_tag = new_tag;
+}
+
+void data_write_hit(unsigned *dirty, unsigned sector, unsigned addr)
 {
 	// write through always generate 1 word to CB stats for DATA_STORE
 	if (!cache_writeback) {
-		data_copy_cache2mem(dirty, CB_1WORD);
+		data_write_word(addr);
 	}
 
 	if (cache_writeback) {
-		*dirty = 1;
+		*dirty |= sector;
 	}
 }
 
-void data_write_miss(int empty, int replace, int old_dirty, int *new_dirty, int *old_tag, int new_tag)
+void data_write_miss(int empty, int replace, unsigned old_dirty, unsigned *new_dirty, int *old_tag, int new_tag, unsigned sector, unsigned addr)
 {
 	// write through always generate 1 word to CB stats for DATA_STORE
 	if (!cache_writeback) {
-		int dummy;
-		data_copy_cache2mem(&dummy, CB_1WORD);
+		data_write_word(addr);
 	}
 
 	cache_stat_data.misses ++;
 	if (cache_writealloc) {
 		if (!empty) {
 			if (cache_writeback && old_dirty)
-				data_copy_cache2mem(new_dirty, CB_1LINE);
+				data_copy_cache2mem(&old_dirty, CB_1LINE);
 			if (replace)
 				cache_stat_data.replacements ++;
 		}
 		data_copy_mem2cache(old_tag, new_tag);
 		// then CPU write to cache again
 		if (cache_writeback) {
-			*new_dirty = 1;
+			*new_dirty |= sector;
 		}
-	} else {
-		// copy data from cpu to mem, no replacement
-		int dummy;
-		data_copy_cache2mem(&dummy, CB_1WORD);
+	} else if (cache_writeback) {
+		// copy data from cpu to mem, no replacement; write through
+		// has already sent the word above
+		data_write_word(addr);
 	}
 }
 /************************************************************/
 extern int cc;
 #define DPRINTF /*(cc<=22 || cc>=26)*/TRUE ? 0 : dprintf
 /************************************************************/
-void perform_access(unsigned addr, unsigned access_type)
+/* XOR of the bits-wide fields of x */
+static unsigned fold_bits(unsigned x, int bits)
 {
-	/* handle an access to the cache */
-	int i, c1_nontag_bits = 0, c2_nontag_bits = 0, c1_tag = 0, c2_tag = 0, c1_idx = 0, c2_idx = 0, c1_no = 0, c2_no = 0;
-	Pcache_line c1_line, c2_line;
-	Pcache_line new_node;
-
-	c1_nontag_bits = ceil(LOG2_FL(c1.n_sets)) + LOG2(cache_block_size);
-	c1_tag = addr >> c1_nontag_bits;
-	c1_idx =  ((addr & c1.index_mask) >> c1.index_mask_offset) % c1.n_sets;
-	c1_line = (Pcache_line)c1.LRU_head[c1_idx];
-	c1_no = c1.set_contents[c1_idx];
-
-	if (cache_split) {
-		c2_nontag_bits = ceil(LOG2_FL(c2.n_sets)) + LOG2(cache_block_size);
-		c2_tag = addr >> c2_nontag_bits;
-		c2_idx =  ((addr & c2.index_mask) >> c2.index_mask_offset) % c2.n_sets;
-		c2_line = (Pcache_line)c2.LRU_head[c2_idx];
-		c2_no = c2.set_contents[c2_idx];
+	unsigned h = 0;
+
+	if (bits == 0)
+		return(0);
+	for (; x; x = (bits < 32) ? x >> bits : 0)
+		h ^= x & ((1u << bits) - 1);
+	return(h);
+}
+
+/* set index of addr in the given way (way only matters for INDEX_SKEW) */
+static int cache_index(Pcache c, unsigned addr, int way)
+{
+	unsigned blk = addr >> c->index_mask_offset;
+	unsigned hi, mask;
+	int r;
+
+	switch (c->index_fn) {
+	case INDEX_XOR:
+		return(fold_bits(blk, c->set_bits) % c->n_sets);
+	case INDEX_PRIME:
+		return(blk % c->n_index_sets);
+	case INDEX_SKEW:
+		/* way w XORs the index bits with the folded upper bits rotated by w */
+		if (c->set_bits == 0)
+			return(0);
+		mask = (1u << c->set_bits) - 1;
+		hi = fold_bits(blk >> c->set_bits, c->set_bits);
+		r = way % c->set_bits;
+		if (r)
+			hi = ((hi << r) | (hi >> (c->set_bits - r))) & mask;
+		return(((blk ^ hi) & mask) % c->n_sets);
+	default:
+		return(((addr & c->index_mask) >> c->index_mask_offset) % c->n_sets);
+	}
+}
+
+/* hashed indices do not determine the upper address bits, so keep them all */
+static unsigned cache_tag(Pcache c, unsigned addr)
+{
+	if (c->index_fn == INDEX_MOD)
+		return(addr >> c->tag_offset);
+	return(addr >> c->index_mask_offset);
+}
+
+/* returns the line holding tag and marks it most recently used, or NULL */
+static Pcache_line cache_find(Pcache c, unsigned addr, unsigned tag)
+{
+	Pcache_line cur;
+	int idx, w;
+
+	if (c->index_fn == INDEX_SKEW) {
+		for (w = 0; w < c->associativity; w++) {
+			cur = &c->lines[w * c->n_sets + cache_index(c, addr, w)];
+			if (cur->valid && cur->tag == tag) {
+				cur->last_use = ++lru_clock;
+				return(cur);
+			}
+		}
+		return(NULL);
+	}
+
+	idx = cache_index(c, addr, 0);
+	for (cur = c->LRU_head[idx]; cur; cur = cur->LRU_next)
+		if (cur->tag == tag)
+			break;
+	if (cur && c->set_contents[idx] > 1) {
+		// switch nodes to maintain order of LRU
+		delete(&c->LRU_head[idx], &c->LRU_tail[idx], cur);
+		insert(&c->LRU_head[idx], &c->LRU_tail[idx], cur);
+	}
+	return(cur);
+}
+
+/*
+ * swaps a filled line with the victim cache: the line's block is taken
+ * back out if present, and the line it displaced is parked in the LRU
+ * entry, whose dirty sub-blocks are written back; returns the valid
+ * mask recovered for the line
+ */
+static unsigned victim_swap(Pcache c, Pcache_line line, Pcache_line evicted)
+{
+	Pcache_line e, slot = NULL;
+	unsigned recovered = 0;
+	int i;
+
+	for (i = 0; i < c->n_victims; i++) {
+		e = &c->victims[i];
+		if (e->valid && e->block == line->block) {
+			recovered = e->valid;
+			line->valid |= e->valid;
+			line->dirty = e->dirty;
+			e->valid = 0;
+			break;
+		}
+	}
+
+	if (evicted->valid) {
+		for (i = 0; i < c->n_victims; i++) {
+			e = &c->victims[i];
+			if (!e->valid) {
+				slot = e;
+				break;
+			}
+			if (!slot || e->last_use < slot->last_use)
+				slot = e;
+		}
+		if (slot->valid && slot->dirty)
+			data_copy_cache2mem(&slot->dirty, CB_1LINE);
+		*slot = *evicted;
+		slot->last_use = ++lru_clock;
+	}
+
+	return(recovered);
+}
+
+/* returns the victim cache entry holding addr's block, or NULL */
+static Pcache_line victim_find(Pcache c, unsigned addr)
+{
+	unsigned block = addr >> c->index_mask_offset;
+	int i;
+
+	for (i = 0; i < c->n_victims; i++)
+		if (c->victims[i].valid && c->victims[i].block == block) {
+			c->victims[i].last_use = ++lru_clock;
+			return(&c->victims[i]);
+		}
+	return(NULL);
+}
+
+/*
+ * allocates a most recently used line for addr with only the given
+ * sub-block valid, evicting the LRU candidate if there is no free one;
+ * the caller's miss handler fills in the tag.  With a victim cache the
+ * evicted line is parked there instead of written back, and *recovered
+ * gets the valid mask of a line brought back from it.
+ */
+static Pcache_line cache_fill(Pcache c, unsigned addr, unsigned sector, int *empty, int *replace, unsigned *old_dirty, unsigned *recovered)
+{
+	Pcache_line cur, victim = NULL;
+	cache_line evicted;
+	int idx, w;
+
+	*empty = 0;
+	*replace = 0;
+	*old_dirty = 0;
+	*recovered = 0;
+	evicted.valid = 0;
+
+	if (c->index_fn == INDEX_SKEW) {
+		for (w = 0; w < c->associativity; w++) {
+			cur = &c->lines[w * c->n_sets + cache_index(c, addr, w)];
+			if (!cur->valid) {
+				victim = cur;
+				break;
+			}
+			if (!victim || cur->last_use < victim->last_use)
+				victim = cur;
+		}
+		if (victim->valid) {
+			*replace = 1;
+			*old_dirty = victim->dirty;
+			evicted = *victim;
+		}
+	} else {
+		idx = cache_index(c, addr, 0);
+		if (c->set_contents[idx] == 0) {
+			*empty = 1;
+		} else if (c->set_contents[idx] >= c->associativity) {
+			// Not Insertable, need replace LRU
+			victim = c->LRU_tail[idx];
+			*replace = 1;
+			*old_dirty = victim->dirty;
+			evicted = *victim;
+			delete(&c->LRU_head[idx], &c->LRU_tail[idx], victim);
+			c->set_contents[idx] --;
+		}
+		if (!victim)
+			victim = (Pcache_line)malloc(sizeof(cache_line));
+	}
+
+	memset(victim, 0, sizeof(cache_line));
+	victim->valid = sector;
+	victim->block = addr >> c->index_mask_offset;
+	if (c->index_fn == INDEX_SKEW) {
+		victim->last_use = ++lru_clock;
 	} else {
-		c2_tag = c1_tag;
-		c2_idx = c1_idx;
-		c2_line = c1_line;
-		c2_no = c1_no;
+		insert(&c->LRU_head[idx], &c->LRU_tail[idx], victim);
+		c->set_contents[idx] ++;
 	}
 
+	if (c->n_victims > 0) {
+		*recovered = victim_swap(c, victim, &evicted);
+		*old_dirty = 0;
+	}
+	return(victim);
+}
+
+void perform_access(unsigned addr, unsigned access_type)
+{
+	/* handle an access to the cache */
+	Pcache c = (access_type == TRACE_INST_LOAD) ? &c1 : &c2;
+	unsigned tag = cache_tag(c, addr);
+	unsigned sector = 1u << ((addr % cache_block_size) / sub_block_size);
+	unsigned old_dirty, recovered, dummy_dirty = 0;
+	int empty, replace, dummy = 0;
+	Pcache_line line;
+
+	/*
+	 * a resident line whose sub-block is not valid misses without a
+	 * replacement: only the sub-block is fetched.  A line recovered from
+	 * the victim cache with its sub-block valid fetches nothing.
+	 */
+
 	/* update access */
 	switch (access_type) {
 	case TRACE_INST_LOAD://2
 		cache_stat_inst.accesses ++;
-		if (c1_no == 0) {
-			// Miss
-			new_node = (Pcache_line)malloc(sizeof(cache_line));
-			memset(new_node, 0, sizeof(cache_line));
-			insert(&c1.LRU_head[c1_idx], &c1.LRU_tail[c1_idx], new_node);
-			c1.set_contents[c1_idx] ++;
-			inst_load_miss(1, 0, new_node->dirty, &new_node->dirty, &new_node->tag, c1_tag);
+		if ((line = cache_find(c, addr, tag)) && (line->valid & sector)) {
+			inst_load_hit();
+		} else if (line) {
+			cache_stat_inst.sector_misses ++;
+			line->valid |= sector;
+			inst_load_miss(0, 0, 0, &line->dirty, &line->tag, tag);
 		} else {
-			Pcache_line cur = (Pcache_line)c1.LRU_head[c1_idx];
-			int found = 0;
-			while (cur) {
-				if (c1_tag == cur->tag) {
-					found = 1;
-					break;
-				}
-				cur = cur->LRU_next;
-			}
-			if (!found) {
-				// Miss
-				if (c1_no < cache_assoc) {
-					// Insertable
-					new_node = (Pcache_line)malloc(sizeof(cache_line));
-					memset(new_node, 0, sizeof(cache_line));
-					insert(&c1.LRU_head[c1_idx], &c1.LRU_tail[c1_idx], new_node);
-					c1.set_contents[c1_idx] ++;
-					inst_load_miss(0, 0, new_node->dirty, &new_node->dirty, &new_node->tag, c1_tag);
-				} else {
-					// Not Insertable, need replace LRU
-					// delete(tail)
-					int old_dirty = c1.LRU_tail[c1_idx]->dirty;
-					delete(&c1.LRU_head[c1_idx], &c1.LRU_tail[c1_idx], c1.LRU_tail[c1_idx]);
-					c1.set_contents[c1_idx] --;
-					// insert(new)
-					new_node = (Pcache_line)malloc(sizeof(cache_line));
-					memset(new_node, 0, sizeof(cache_line));
-					insert(&c1.LRU_head[c1_idx], &c1.LRU_tail[c1_idx], new_node);
-					c1.set_contents[c1_idx] ++;
-					inst_load_miss(0, 1, old_dirty, &new_node->dirty, &new_node->tag, c1_tag);
-				}
-			} else {
-				// Hit
-				if (c1_no > 1) {
-					// switch nodes to maintain order of LRU
-					delete(&c1.LRU_head[c1_idx], &c1.LRU_tail[c1_idx], cur);
-					insert(&c1.LRU_head[c1_idx], &c1.LRU_tail[c1_idx], cur);
-				}
-				inst_load_hit();
-			}
+			line = cache_fill(c, addr, sector, &empty, &replace, &old_dirty, &recovered);
+			if (recovered & sector)
+				inst_victim_hit(replace, &line->tag, tag);
+			else
+				inst_load_miss(empty, replace, old_dirty, &line->dirty, &line->tag, tag);
 		}
 		break;
-    case TRACE_DATA_LOAD://0
+	case TRACE_DATA_LOAD://0
 		cache_stat_data.accesses ++;
-		if (c2_no == 0) {
-			// Miss
-			new_node = (Pcache_line)malloc(sizeof(cache_line));
-			memset(new_node, 0, sizeof(cache_line));
-			insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], new_node);
-			c2.set_contents[c2_idx] ++;
-			data_load_miss(1, 0, new_node->dirty, &new_node->dirty, &new_node->tag, c2_tag);
+		if ((line = cache_find(c, addr, tag)) && (line->valid & sector)) {
+			data_load_hit();
+		} else if (line) {
+			cache_stat_data.sector_misses ++;
+			line->valid |= sector;
+			data_load_miss(0, 0, 0, &line->dirty, &line->tag, tag);
 		} else {
-			Pcache_line cur = (Pcache_line)c2.LRU_head[c2_idx];
-			int found = 0;
-			while (cur) {
-				if (c2_tag == cur->tag) {
-					found = 1;
-					break;
-				}
-				cur = cur->LRU_next;
-			}
-			if (!found) {
-				// Miss
-				if (c2_no < cache_assoc) {
-					// Insertable
-					new_node = (Pcache_line)malloc(sizeof(cache_line));
-					memset(new_node, 0, sizeof(cache_line));
-					insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], new_node);
-					c2.set_contents[c2_idx] ++;
-					data_load_miss(0, 0, new_node->dirty, &new_node->dirty, &new_node->tag, c2_tag);
-				} else {
-					// Not Insertable, need replace LRU
-					// delete(tail)
-					int old_dirty = c2.LRU_tail[c2_idx]->dirty;
-					delete(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], c2.LRU_tail[c2_idx]);
-					if (old_dirty==1)
-						old_dirty = old_dirty;
-					c2.set_contents[c2_idx] --;
-					// insert(new)
-					new_node = (Pcache_line)malloc(sizeof(cache_line));
-					memset(new_node, 0, sizeof(cache_line));
-					insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], new_node);
-					c2.set_contents[c2_idx] ++;
-					data_load_miss(0, 1, old_dirty, &new_node->dirty, &new_node->tag, c2_tag);
-				}
-			} else {
-				// Hit
-				if (c2_no > 1) {
-					// switch nodes to maintain order of LRU
-					delete(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], cur);
-					insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], cur);
-				}
-				data_load_hit();
-			}
+			line = cache_fill(c, addr, sector, &empty, &replace, &old_dirty, &recovered);
+			if (recovered & sector)
+				data_victim_hit(replace, &line->tag, tag);
+			else
+				data_load_miss(empty, replace, old_dirty, &line->dirty, &line->tag, tag);
 		}
 		break;
-    case TRACE_DATA_STORE://1
+	case TRACE_DATA_STORE://1
 		cache_stat_data.accesses ++;
-		if (cache_writealloc) {
-			if (c2_no == 0) {
-				// Miss
-				new_node = (Pcache_line)malloc(sizeof(cache_line));
-				memset(new_node, 0, sizeof(cache_line));
-				insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], new_node);
-				c2.set_contents[c2_idx] ++;
-				data_write_miss(1, 0, new_node->dirty, &new_node->dirty, &new_node->tag, c2_tag);
-			} else {
-				Pcache_line cur = (Pcache_line)c2.LRU_head[c2_idx];
-				int found = 0;
-				while (cur) {
-					if (c2_tag == cur->tag) {
-						found = 1;
-						break;
-					}
-					cur = cur->LRU_next;
-				}
-				if (!found) {
-					// Miss
-					if (c2_no < cache_assoc) {
-						// Insertable
-						new_node = (Pcache_line)malloc(sizeof(cache_line));
-						memset(new_node, 0, sizeof(cache_line));
-						insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], new_node);
-						c2.set_contents[c2_idx] ++;
-						data_write_miss(0, 0, new_node->dirty, &new_node->dirty, &new_node->tag, c2_tag);
-					} else {
-						// Not Insertable, need replace LRU
-						// delete(tail)
-						int old_dirty = c2.LRU_tail[c2_idx]->dirty;
-						delete(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], c2.LRU_tail[c2_idx]);
-						c2.set_contents[c2_idx] --;
-						// insert(new)
-						new_node = (Pcache_line)malloc(sizeof(cache_line));
-						memset(new_node, 0, sizeof(cache_line));
-						insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], new_node);
-						c2.set_contents[c2_idx] ++;
-						data_write_miss(0, 1, old_dirty, &new_node->dirty, &new_node->tag, c2_tag);
-					}
-				} else {
-					// Hit
-					if (c2_no > 1) {
-						// switch nodes to maintain order of LRU
-						delete(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], cur);
-						insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], cur);
-					}
-					data_write_hit(&cur->dirty);
-				}
+		if ((line = cache_find(c, addr, tag)) && (line->valid & sector)) {
+			data_write_hit(&line->dirty, sector, addr);
+		} else if (!cache_writealloc) {
+			// Write non allocate: no cache line will be allocated
+			if (line) {
+				cache_stat_data.sector_misses ++;
+			} else if ((line = victim_find(c, addr)) && (line->valid & sector)) {
+				// the block is parked in the victim cache: write it there
+				cache_stat_data.misses ++;
+				cache_stat_data.victim_hits ++;
+				data_write_hit(&line->dirty, sector, addr);
+				break;
 			}
+			data_write_miss(0, 0, 0, &dummy_dirty, &dummy, 0, sector, addr);
+		} else if (line) {
+			cache_stat_data.sector_misses ++;
+			line->valid |= sector;
+			data_write_miss(0, 0, 0, &line->dirty, &line->tag, tag, sector, addr);
 		} else {
-			// Write non allocate
-			Pcache_line cur = (Pcache_line)c2.LRU_head[c2_idx];
-			int found = 0, dummy = 0;
-			while (cur) {
-				if (c2_tag == cur->tag) {
-					found = 1;
-					break;
-				}
-				cur = cur->LRU_next;
-			}
-			// no cache will be modified
-			if (found) {
-				if (c2_no > 1) {
-					// switch nodes to maintain order of LRU
-					delete(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], cur);
-					insert(&c2.LRU_head[c2_idx], &c2.LRU_tail[c2_idx], cur);
-				}
-				data_write_hit(&cur->dirty);
+			line = cache_fill(c, addr, sector, &empty, &replace, &old_dirty, &recovered);
+			if (recovered & sector) {
+				data_victim_hit(replace, &line->tag, tag);
+				data_write_hit(&line->dirty, sector, addr);
 			} else {
-				data_write_miss(0, 0, 0, &dummy, &dummy, 0);
+				data_write_miss(empty, replace, old_dirty, &line->dirty, &line->tag, tag, sector, addr);
 			}
 		}
 		break;
@@ -434,26 +698,88 @@ void perform_access(unsigned addr, unsigned access_type)
 /************************************************************/
 
 /************************************************************/
-void flush()
+static void flush_one_cache(Pcache c)
 {
-	/* flush the cache */
-	int i, j;
-	for (i=0; i<c1.n_sets; i++) {
-		Pcache_line cur = c1.LRU_head[i];
-		while (cur) {
-			if (cur->dirty)
-				data_copy_cache2mem(&c1.LRU_head[i]->dirty, CB_1LINE);
-			cur = cur->LRU_next;
-		}
+	Pcache_line cur;
+	int i;
+
+	for (i = 0; i < c->n_victims; i++)
+		if (c->victims[i].valid && c->victims[i].dirty)
+			data_copy_cache2mem(&c->victims[i].dirty, CB_1LINE);
+
+	if (c->index_fn == INDEX_SKEW) {
+		for (i = 0; i < c->n_sets * c->associativity; i++)
+			if (c->lines[i].valid && c->lines[i].dirty)
+				data_copy_cache2mem(&c->lines[i].dirty, CB_1LINE);
+		return;
 	}
-	for (i=0; i<c2.n_sets; i++) {
-		Pcache_line cur = c2.LRU_head[i];
-		while (cur) {
+
+	for (i = 0; i < c->n_sets; i++)
+		for (cur = c->LRU_head[i]; cur; cur = cur->LRU_next)
 			if (cur->dirty)
-				data_copy_cache2mem(&c2.LRU_head[i]->dirty, CB_1LINE);
-			cur = cur->LRU_next;
-		}
+				data_copy_cache2mem(&cur->dirty, CB_1LINE);
+}
+
+void flush()
+{
+	/* flush the cache; a unified cache shares its lines with c2 */
+	flush_one_cache(&c1);
+	if (cache_split)
+		flush_one_cache(&c2);
+
+	/* and the write buffer */
+	while (wbuf.count > 0)
+		write_buffer_drain();
+}
+/************************************************************/
+
+/************************************************************/
+static void free_one_cache(Pcache c)
+{
+	Pcache_line cur, next;
+	int i;
+
+	if (c->index_fn == INDEX_SKEW) {
+		free(c->lines);
+	} else {
+		for (i = 0; i < c->n_sets; i++)
+			for (cur = c->LRU_head[i]; cur; cur = next) {
+				next = cur->LRU_next;
+				free(cur);
+			}
+		free(c->LRU_head);
+		free(c->LRU_tail);
+		free(c->set_contents);
 	}
+	free(c->victims);
+	memset(c, 0, sizeof(cache));
+}
+
+/* frees the cache model and clears its statistics, ready for init_cache */
+void reset_cache()
+{
+	free_one_cache(&c1);
+	if (cache_split)
+		free_one_cache(&c2);
+	memset(&c2, 0, sizeof(cache));
+
+	free(wbuf.block);
+	free(wbuf.written);
+	memset(&wbuf, 0, sizeof(wbuf));
+
+	memset(&cache_stat_inst, 0, sizeof(cache_stat));
+	memset(&cache_stat_data, 0, sizeof(cache_stat));
+	memset(&wbuf_stat, 0, sizeof(write_buffer_stat));
+	lru_clock = 0;
+}
+
+/* accesses, misses and memory traffic in words over both streams */
+void cache_totals(int *accesses, int *misses, int *traffic)
+{
+	*accesses = cache_stat_inst.accesses + cache_stat_data.accesses;
+	*misses = cache_stat_inst.misses + cache_stat_data.misses;
+	*traffic = cache_stat_inst.demand_fetches + cache_stat_data.demand_fetches +
+		cache_stat_inst.copies_back + cache_stat_data.copies_back;
 }
 /************************************************************/
 
@@ -497,23 +823,38 @@ void insert(head, tail, item)
 /************************************************************/
 
 /************************************************************/
-void dump_settings()
+void fdump_settings(FILE *out)
 {
-  printf("Cache Settings:\n");
+  fprintf(out, "Cache Settings:\n");
   if (cache_split) {
-    printf("\tSplit I- D-cache\n");
-    printf("\tI-cache size: \t%d\n", cache_isize);
-    printf("\tD-cache size: \t%d\n", cache_dsize);
+    fprintf(out, "\tSplit I- D-cache\n");
+    fprintf(out, "\tI-cache size: \t%d\n", cache_isize);
+    fprintf(out, "\tD-cache size: \t%d\n", cache_dsize);
   } else {
-    printf("\tUnified I- D-cache\n");
-    printf("\tSize: \t%d\n", cache_usize);
+    fprintf(out, "\tUnified I- D-cache\n");
+    fprintf(out, "\tSize: \t%d\n", cache_usize);
   }
-  printf("\tAssociativity: \t%d\n", cache_assoc);
-  printf("\tBlock size: \t%d\n", cache_block_size);
-  printf("\tWrite policy: \t%s\n", 
-	 cache_writeback ? "WRITE BACK" : "WRITE THROUGH");
-  printf("\tAllocation policy: \t%s\n",
-	 cache_writealloc ? "WRITE ALLOCATE" : "WRITE NO ALLOCATE");
+  fprintf(out, "\tAssociativity: \t%d\n", cache_assoc);
+  fprintf(out, "\tBlock size: \t%d\n", cache_block_size);
+  fprintf(out, "\tSub-block size: \t%d\n",
+	       (cache_sub_block_size > 0 && cache_sub_block_size <= cache_block_size) ?
+	       cache_sub_block_size : cache_block_size);
+  fprintf(out, "\tWord size: \t%d\n", cache_word_size);
+  fprintf(out, "\tVictim cache entries: \t%d\n", cache_victim_size);
+  fprintf(out, "\tWrite buffer entries: \t%d\n", cache_write_buffer_size);
+  fprintf(out, "\tWrite policy: \t%s\n", 
+	       cache_writeback ? "WRITE BACK" : "WRITE THROUGH");
+  fprintf(out, "\tAllocation policy: \t%s\n",
+	       cache_writealloc ? "WRITE ALLOCATE" : "WRITE NO ALLOCATE");
+  fprintf(out, "\tIndex function: \t%s\n",
+	       (cache_index_fn == INDEX_XOR) ? "XOR FOLD" :
+	       (cache_index_fn == INDEX_PRIME) ? "PRIME MODULO" :
+	       (cache_index_fn == INDEX_SKEW) ? "SKEWED" : "MODULO");
+}
+
+void dump_settings()
+{
+  fdump_settings(stdout);
 }
 /************************************************************/
 
@@ -527,6 +868,10 @@ void print_stats()
   printf("  miss rate: %f\n", 
 	 (float)cache_stat_inst.misses / (float)cache_stat_inst.accesses);
   printf("  replace:   %d\n", cache_stat_inst.replacements);
+  if (sub_block_size < cache_block_size)
+    printf("  sub-block misses: %d\n", cache_stat_inst.sector_misses);
+  if (cache_victim_size > 0)
+    printf("  victim hits: %d\n", cache_stat_inst.victim_hits);
 
   printf("  DATA\n");
   printf("  accesses:  %d\n", cache_stat_data.accesses);
@@ -534,11 +879,30 @@ void print_stats()
   printf("  miss rate: %f\n", 
 	 (float)cache_stat_data.misses / (float)cache_stat_data.accesses);
   printf("  replace:   %d\n", cache_stat_data.replacements);
+  if (sub_block_size < cache_block_size)
+    printf("  sub-block misses: %d\n", cache_stat_data.sector_misses);
+  if (cache_victim_size > 0)
+    printf("  victim hits: %d\n", cache_stat_data.victim_hits);
 
   printf("  TRAFFIC (in words)\n");
   printf("  demand fetch:  %d\n", cache_stat_inst.demand_fetches + 
 	 cache_stat_data.demand_fetches);
   printf("  copies back:   %d\n", cache_stat_inst.copies_back +
 	 cache_stat_data.copies_back);
+
+  if (cache_write_buffer_size > 0) {
+    printf("  WRITE BUFFER\n");
+    printf("  stores:  %d\n", wbuf_stat.stores);
+    printf("  merges:  %d\n", wbuf_stat.merges);
+    printf("  drains:  %d\n", wbuf_stat.drains);
+  }
+}
+/************************************************************/
+
+/************************************************************/
+Pstat_entry cache_stat_entries(int *n)
+{
+  *n = sizeof(cache_stat_table) / sizeof(cache_stat_table[0]);
+  return(cache_stat_table);
 }
 /************************************************************/
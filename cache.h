@@ -19,10 +19,11 @@
 #define FALSE 0
 
 /* default cache parameters--can be changed */
-#define WORD_SIZE 4
-#define WORD_SIZE_OFFSET 2
+#define DEFAULT_WORD_SIZE 4
 #define DEFAULT_CACHE_SIZE (8 * 1024)
 #define DEFAULT_CACHE_BLOCK_SIZE 16
+#define DEFAULT_CACHE_SUB_BLOCK_SIZE 0	/* 0: one sub-block per line */
+#define MAX_SUB_BLOCKS 32		/* bits in the valid/dirty masks */
 #define DEFAULT_CACHE_ASSOC 1
 #define DEFAULT_CACHE_WRITEBACK TRUE
 #define DEFAULT_CACHE_WRITEALLOC TRUE
@@ -37,12 +38,29 @@
 #define CACHE_PARAM_WRITETHROUGH 6
 #define CACHE_PARAM_WRITEALLOC 7
 #define CACHE_PARAM_NOWRITEALLOC 8
+#define CACHE_PARAM_INDEX 9
+#define CACHE_PARAM_WORD_SIZE 10
+#define CACHE_PARAM_SUB_BLOCK_SIZE 11
+#define CACHE_PARAM_VICTIM_SIZE 12
+#define CACHE_PARAM_WRITE_BUFFER_SIZE 13
+
+/* set index functions */
+#define INDEX_MOD 0		/* address bits above the block offset */
+#define INDEX_XOR 1		/* XOR-fold of all block address bits */
+#define INDEX_PRIME 2		/* block address modulo a prime */
+#define INDEX_SKEW 3		/* skewed-associative, one hash per way */
+#define DEFAULT_CACHE_INDEX INDEX_MOD
+#define DEFAULT_VICTIM_CACHE_SIZE 0
+#define DEFAULT_WRITE_BUFFER_SIZE 0
 
 
 /* structure definitions */
 typedef struct cache_line_ {
   unsigned tag;
-  int dirty;
+  unsigned block;		/* block address (victim cache) */
+  unsigned dirty;		/* mask of dirty sub-blocks */
+  unsigned valid;		/* mask of valid sub-blocks, 0 if unused */
+  unsigned last_use;		/* LRU timestamp (skewed, victim caches) */
 
   struct cache_line_ *LRU_next;
   struct cache_line_ *LRU_prev;
@@ -54,28 +72,55 @@ typedef struct cache_ {
   int n_sets;			/* number of cache sets */
   unsigned index_mask;		/* mask to find cache index */
   int index_mask_offset;	/* number of zero bits in mask */
+  int tag_offset;		/* number of non-tag bits (INDEX_MOD) */
+  int index_fn;			/* set index function */
+  int set_bits;			/* index bits produced by the hashes */
+  int n_index_sets;		/* sets reachable by the index function */
   Pcache_line *LRU_head;	/* head of LRU list for each set */
   Pcache_line *LRU_tail;	/* tail of LRU list for each set */
   int *set_contents;		/* number of valid entries in set */
+  Pcache_line lines;		/* skewed: way w, set s at [w * n_sets + s] */
+  Pcache_line victims;		/* fully associative victim cache */
+  int n_victims;		/* number of victim cache entries */
 } cache, *Pcache;
 
+typedef struct write_buffer_ {
+  int size;			/* number of entries */
+  int head;			/* oldest entry */
+  int count;			/* number of entries in use */
+  unsigned *block;		/* block address of each entry */
+  char *written;		/* words written, words_per_block per entry */
+} write_buffer, *Pwrite_buffer;
+
 typedef struct cache_stat_ {
   int accesses;			/* number of memory references */
   int misses;			/* number of cache misses */
   int replacements;		/* number of misses that cause replacments */
   int demand_fetches;		/* number of fetches */
   int copies_back;		/* number of write backs */
+  int sector_misses;		/* misses to a resident line's sub-block */
+  int victim_hits;		/* misses satisfied by the victim cache */
 } cache_stat, *Pcache_stat;
 
+typedef struct write_buffer_stat_ {
+  int stores;			/* words written to the buffer */
+  int merges;			/* stores combined into an existing entry */
+  int drains;			/* entries written to memory */
+} write_buffer_stat, *Pwrite_buffer_stat;
+
 
 /* function prototypes */
 void set_cache_param();
+int get_cache_param();
 void init_cache();
 void perform_access();
 void flush();
+void reset_cache();
+void cache_totals();
 void delete();
 void insert();
 void dump_settings();
+void fdump_settings();
 void print_stats();
 
 
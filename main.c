@@ -7,10 +7,23 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "cache.h"
 #include "main.h"
+#include "trace.h"
+#include "tlb.h"
+#include "results.h"
+#include "search.h"
 
 static FILE *traceFile;
+static char *traceName;
+static int traceThreads = 1;
+static char *resultStore = NULL;
+static int searchMode = FALSE;
+static int searchBudget = DEFAULT_SEARCH_BUDGET;
+static double searchTarget = DEFAULT_SEARCH_TARGET;
+static int searchTraffic = DEFAULT_SEARCH_TRAFFIC;
 
 
 int main(argc, argv)
@@ -19,8 +32,23 @@ int main(argc, argv)
 {
   parse_args(argc, argv);
   init_cache();
-  play_trace(traceFile);
+  init_tlb();
+  if (searchMode) {
+    open_trace_input();
+    load_search_trace(traceFile);
+    close_trace_input();
+    run_search(searchBudget, searchTarget, searchTraffic);
+    exit(0);
+  }
+  if (!resultStore || !find_results(resultStore, traceName)) {
+    open_trace_input();
+    play_trace(traceFile);
+    close_trace_input();
+    if (resultStore)
+      save_results(resultStore, traceName);
+  }
   print_stats();
+  print_tlb_stats();
   {
 	  char a;
 	  scanf("%c",&a);
@@ -37,6 +65,8 @@ void parse_args(argc, argv)
 
   if (argc < 2) {
     printf("usage:  cache <options> <trace file>\n");
+    printf("\t<trace file> may be a named pipe, or - for stdin, and may be\n");
+    printf("\tgzip, zstd or xz compressed\n");
     exit(-1);
   }
 
@@ -53,6 +83,25 @@ void parse_args(argc, argv)
       printf("\t-wt: \t\tset write policy to write through\n");
       printf("\t-wa: \t\tset allocation policy to write allocate\n");
       printf("\t-nw: \t\tset allocation policy to no write allocate\n");
+      printf("\t-ss <ss>: \tset sub-block (sector) size to <ss>\n");
+      printf("\t-ws <ws>: \tset word size to <ws>\n");
+      printf("\t-vc <n>: \tadd an <n> entry victim cache\n");
+      printf("\t-wcb <n>: \tadd an <n> entry write-combining buffer\n");
+      printf("\t-idx <f>: \tset index function to mod, xor, prime or skew\n");
+      printf("\t-tlb <n>: \tmodel <n> entry I- and D-TLBs, translating addresses\n");
+      printf("\t-tlba <a>: \tset TLB associativity to <a>\n");
+      printf("\t-tlb2 <n>: \tadd a shared <n> entry second level TLB\n");
+      printf("\t-tlb2a <a>: \tset second level TLB associativity to <a>\n");
+      printf("\t-ps <ps>: \tset page size to <ps>\n");
+      printf("\t-hps <hs>: \tset huge page size to <hs>\n");
+      printf("\t-hp <s>: \tmap d(ata), i(nstruction) or id streams with huge pages\n");
+      printf("\t-pmap <p>: \tallocate physical pages seq(uentially) or scatter(ed)\n");
+      printf("\t-j <n>: \tparse a plain text trace file on <n> threads (0 = all cores)\n");
+      printf("\t-rc <file>: \treuse and record results in the CSV store <file>\n");
+      printf("\t-search: \tsearch unified size, block size and associativity\n");
+      printf("\t-budget <bytes>: \tlargest cache size the search considers\n");
+      printf("\t-target <rate>: \tmiss rate the search must meet\n");
+      printf("\t-traffic <words>: \tmemory traffic the search must stay under\n");
       exit(0);
     }
     
@@ -120,22 +169,213 @@ void parse_args(argc, argv)
       continue;
     }
 
+    if (!strcmp(argv[arg_index], "-ss")) {
+      value = atoi(argv[arg_index+1]);
+      set_cache_param(CACHE_PARAM_SUB_BLOCK_SIZE, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-ws")) {
+      value = atoi(argv[arg_index+1]);
+      set_cache_param(CACHE_PARAM_WORD_SIZE, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-vc")) {
+      value = atoi(argv[arg_index+1]);
+      set_cache_param(CACHE_PARAM_VICTIM_SIZE, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-wcb")) {
+      value = atoi(argv[arg_index+1]);
+      set_cache_param(CACHE_PARAM_WRITE_BUFFER_SIZE, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-idx")) {
+      if (!strcmp(argv[arg_index+1], "mod"))
+	value = INDEX_MOD;
+      else if (!strcmp(argv[arg_index+1], "xor"))
+	value = INDEX_XOR;
+      else if (!strcmp(argv[arg_index+1], "prime"))
+	value = INDEX_PRIME;
+      else if (!strcmp(argv[arg_index+1], "skew"))
+	value = INDEX_SKEW;
+      else {
+	printf("error:  unknown index function %s\n", argv[arg_index+1]);
+	exit(-1);
+      }
+      set_cache_param(CACHE_PARAM_INDEX, value);
+      arg_index += 2;
+      continue;
+    }
+
+    /* set the TLB simulator parameters */
+
+    if (!strcmp(argv[arg_index], "-tlb")) {
+      value = atoi(argv[arg_index+1]);
+      set_tlb_param(TLB_PARAM_ENTRIES, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-tlba")) {
+      value = atoi(argv[arg_index+1]);
+      set_tlb_param(TLB_PARAM_ASSOC, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-tlb2")) {
+      value = atoi(argv[arg_index+1]);
+      set_tlb_param(TLB_PARAM_L2_ENTRIES, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-tlb2a")) {
+      value = atoi(argv[arg_index+1]);
+      set_tlb_param(TLB_PARAM_L2_ASSOC, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-ps")) {
+      value = atoi(argv[arg_index+1]);
+      set_tlb_param(TLB_PARAM_PAGE_SIZE, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-hps")) {
+      value = atoi(argv[arg_index+1]);
+      set_tlb_param(TLB_PARAM_HUGE_PAGE_SIZE, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-hp")) {
+      if (!strcmp(argv[arg_index+1], "d"))
+	value = HUGE_DATA;
+      else if (!strcmp(argv[arg_index+1], "i"))
+	value = HUGE_INST;
+      else if (!strcmp(argv[arg_index+1], "id") || !strcmp(argv[arg_index+1], "di"))
+	value = HUGE_DATA | HUGE_INST;
+      else {
+	printf("error:  unknown huge page streams %s\n", argv[arg_index+1]);
+	exit(-1);
+      }
+      set_tlb_param(TLB_PARAM_HUGE_PAGES, value);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-pmap")) {
+      if (!strcmp(argv[arg_index+1], "seq"))
+	value = PMAP_SEQ;
+      else if (!strcmp(argv[arg_index+1], "scatter"))
+	value = PMAP_SCATTER;
+      else {
+	printf("error:  unknown page allocation policy %s\n", argv[arg_index+1]);
+	exit(-1);
+      }
+      set_tlb_param(TLB_PARAM_PAGE_MAP, value);
+      arg_index += 2;
+      continue;
+    }
+
+    /* set the trace loader parameters */
+
+    if (!strcmp(argv[arg_index], "-j")) {
+      traceThreads = atoi(argv[arg_index+1]);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-rc")) {
+      resultStore = argv[arg_index+1];
+      arg_index += 2;
+      continue;
+    }
+
+    /* set the design-space search parameters */
+
+    if (!strcmp(argv[arg_index], "-search")) {
+      searchMode = TRUE;
+      arg_index += 1;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-budget")) {
+      searchBudget = atoi(argv[arg_index+1]);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-target")) {
+      searchTarget = atof(argv[arg_index+1]);
+      arg_index += 2;
+      continue;
+    }
+
+    if (!strcmp(argv[arg_index], "-traffic")) {
+      searchTraffic = atoi(argv[arg_index+1]);
+      arg_index += 2;
+      continue;
+    }
+
     printf("error:  unrecognized flag %s\n", argv[arg_index]);
     exit(-1);
 
   }
 
   dump_settings();
+  dump_tlb_settings();
 
-  /* open the trace file */
-  traceFile = fopen(argv[arg_index], "r");
+  traceName = argv[arg_index];
 
   return;
 }
 /************************************************************/
 
+/************************************************************/
+void open_trace_input()
+{
+  /* map and parse the trace in parallel, or stream it from a file, pipe
+     or stdin, decompressing if needed */
+  if (traceThreads != 1 && open_trace_parallel(traceName, traceThreads))
+    traceFile = NULL;
+  else
+    traceFile = open_trace(traceName);
+}
+
+/* a trace that could not be read to the end is fatal, so partial
+   statistics are never printed or stored */
+void close_trace_input()
+{
+  int failed = FALSE;
+
+  if (traceFile)
+    failed = close_trace(traceFile);
+  else
+    close_trace_parallel();
+
+  if (failed) {
+    printf("error:  trace %s could not be read or decoded to the end\n",
+	   traceName);
+    exit(-1);
+  }
+}
+/************************************************************/
+
 int cc = 0;
 /************************************************************/
+/* a NULL inFile reads records from the parallel loader */
 void play_trace(inFile)
   FILE *inFile;
 {
@@ -145,7 +385,8 @@ void play_trace(inFile)
   int cnt = 0;
 
   num_inst = 0;
-  while(read_trace_element(inFile, &access_type, &addr)) {
+  while(inFile ? read_trace_element(inFile, &access_type, &addr)
+	: read_trace_record(&access_type, &addr)) {
 
 	cc++;
 
@@ -153,7 +394,7 @@ void play_trace(inFile)
     case TRACE_DATA_LOAD:
     case TRACE_DATA_STORE:
     case TRACE_INST_LOAD:
-      perform_access(addr, access_type);
+      perform_access(translate(addr, access_type), access_type);
       break;
 
     default:
@@ -174,18 +415,20 @@ int read_trace_element(inFile, access_type, addr)
   FILE *inFile;
   unsigned *access_type, *addr;
 {
-  int result;
-  char c;
-
-  result = fscanf(inFile, "%u %x%c", access_type, addr, &c);
-  while (c != '\n') {
-    result = fscanf(inFile, "%c", &c);
-    if (result == EOF) 
-      break;
+  char line[TRACE_LINE_MAX];
+  size_t len;
+  int found, c;
+
+  /* blank and malformed lines are skipped, as the parallel loader does */
+  while (fgets(line, sizeof(line), inFile)) {
+    len = strlen(line);
+    found = parse_trace_line(line, line + len, access_type, addr);
+    if (len > 0 && line[len - 1] != '\n')
+      while ((c = getc(inFile)) != EOF && c != '\n')
+	;
+    if (found)
+      return(1);
   }
-  if (result != EOF)
-    return(1);
-  else
-    return(0);
+  return(0);
 }
 /************************************************************/
@@ -13,6 +13,8 @@
 #define PRINT_INTERVAL 100000
 
 void parse_args();
+void open_trace_input();
+void close_trace_input();
 void play_trace();
 int read_trace_element();
 
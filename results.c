@@ -0,0 +1,280 @@
+/*
+ * results.c
+ *
+ * Persistent result store.  A finished run is appended to a CSV file
+ * as one row keyed by a fingerprint of the trace and a hash of the
+ * settings that dump_settings()/dump_tlb_settings() print, followed by
+ * one column per statistic.  A later run with the same trace and
+ * settings loads the row into the statistics and skips the replay.
+ *
+ * The fingerprint hashes the trace size and FP_SAMPLES evenly spaced
+ * FP_SAMPLE_SIZE byte samples, so it is cheap even for huge traces
+ * but can miss edits that fall between samples.  Traces read from
+ * pipes or stdin cannot be fingerprinted and are never looked up.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "tlb.h"
+#include "results.h"
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/************************************************************/
+static unsigned long long fnv1a(unsigned long long h, void *buf, size_t len)
+{
+  unsigned char *p = (unsigned char *)buf;
+
+  while (len--) {
+    h ^= *p++;
+    h *= FNV_PRIME;
+  }
+  return(h);
+}
+
+/* hex fingerprint of a regular trace file; FALSE if there is none */
+static int fingerprint(char *trace_name, char *fp)
+{
+  static char buf[FP_SAMPLE_SIZE];
+  unsigned long long h = FNV_OFFSET, size;
+  struct stat st;
+  off_t off;
+  ssize_t n;
+  int fd, i;
+
+  /* never open a pipe: that blocks for a writer and can eat its data */
+  if (stat(trace_name, &st) || !S_ISREG(st.st_mode))
+    return(FALSE);
+  fd = open(trace_name, O_RDONLY);
+  if (fd < 0)
+    return(FALSE);
+
+  size = st.st_size;
+  h = fnv1a(h, &size, sizeof(size));
+  for (i = 0; i < FP_SAMPLES; i++) {
+    off = (size > FP_SAMPLE_SIZE) ?
+      (off_t)((size - FP_SAMPLE_SIZE) / (FP_SAMPLES - 1) * i) : 0;
+    n = pread(fd, buf, FP_SAMPLE_SIZE, off);
+    if (n > 0)
+      h = fnv1a(h, buf, n);
+    if (size <= FP_SAMPLE_SIZE)
+      break;
+  }
+  close(fd);
+
+  sprintf(fp, "%016llx", h);
+  return(TRUE);
+}
+
+/* the printed settings, one "name: value" item per line, joined by "; " */
+static char *settings_text()
+{
+  char *raw, *text, *p, *q;
+  size_t len;
+  FILE *f;
+  int space = 0;
+
+  f = open_memstream(&raw, &len);
+  fdump_settings(f);
+  fdump_tlb_settings(f);
+  fclose(f);
+
+  text = (char *)malloc(2 * len + 1);
+  for (p = raw, q = text; *p; p++) {
+    if (*p == '\n') {
+      while (q > text && q[-1] == ' ')
+	q--;
+      if (p[1]) {
+	*q++ = ';';
+	*q++ = ' ';
+      }
+      space = 0;
+    } else if (*p == ' ' || *p == '\t') {
+      space = (q > text && q[-1] != ' ');
+    } else {
+      if (space)
+	*q++ = ' ';
+      space = 0;
+      *q++ = (*p == '"') ? '\'' : *p;
+    }
+  }
+  *q = '\0';
+
+  free(raw);
+  return(text);
+}
+
+static void header_text(char *buf)
+{
+  Pstat_entry stats;
+  int n, i;
+
+  strcpy(buf, "fingerprint,settings_id,trace");
+  stats = cache_stat_entries(&n);
+  for (i = 0; i < n; i++)
+    sprintf(buf + strlen(buf), ",%s", stats[i].name);
+  stats = tlb_stat_entries(&n);
+  for (i = 0; i < n; i++)
+    sprintf(buf + strlen(buf), ",%s", stats[i].name);
+  strcat(buf, ",settings");
+}
+
+/* splits a CSV line in place; quoted fields may hold commas and "" */
+static int split_csv(char *line, char **fields, int max)
+{
+  char *p = line, *q;
+  int n = 0;
+
+  while (n < max) {
+    if (*p == '"') {
+      fields[n++] = q = ++p;
+      while (*p && !(*p == '"' && p[1] != '"')) {
+	if (*p == '"')
+	  p++;
+	*q++ = *p++;
+      }
+      if (*p == '"')
+	p++;
+      *q = '\0';
+      if (*p != ',')
+	break;
+      p++;
+    } else {
+      fields[n++] = p;
+      p += strcspn(p, ",\n");
+      if (*p != ',') {
+	*p = '\0';
+	break;
+      }
+      *p++ = '\0';
+    }
+  }
+  return(n);
+}
+
+static void put_csv_string(FILE *f, char *s)
+{
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"')
+      fputc('"', f);
+    fputc(*s, f);
+  }
+  fputc('"', f);
+}
+/************************************************************/
+
+/************************************************************/
+/* loads stored statistics for this trace and configuration if present */
+int find_results(char *store, char *trace_name)
+{
+  static char line[RESULTS_LINE_MAX], header[RESULTS_LINE_MAX];
+  char fp[17], id[17], *fields[256], *names[256], *settings;
+  Pstat_entry stats[2];
+  int n_stats[2], n_names, n, i, j, k, found = FALSE;
+  FILE *f;
+
+  if (!fingerprint(trace_name, fp))
+    return(FALSE);
+  f = fopen(store, "r");
+  if (!f)
+    return(FALSE);
+
+  settings = settings_text();
+  sprintf(id, "%016llx", fnv1a(FNV_OFFSET, settings, strlen(settings)));
+
+  /* columns are matched by name, so older stores still load */
+  if (!fgets(header, sizeof(header), f)) {
+    fclose(f);
+    free(settings);
+    return(FALSE);
+  }
+  n_names = split_csv(header, names, 256);
+
+  stats[0] = cache_stat_entries(&n_stats[0]);
+  stats[1] = tlb_stat_entries(&n_stats[1]);
+
+  while (!found && fgets(line, sizeof(line), f)) {
+    n = split_csv(line, fields, 256);
+    if (n != n_names || n < 3 || strcmp(fields[0], fp) || strcmp(fields[1], id)
+	|| strcmp(fields[n - 1], settings))
+      continue;
+
+    found = TRUE;
+    for (k = 0; k < 2 && found; k++)
+      for (i = 0; i < n_stats[k] && found; i++) {
+	for (j = 0; j < n_names; j++)
+	  if (!strcmp(names[j], stats[k][i].name))
+	    break;
+	if (j == n_names)
+	  found = FALSE;
+	else
+	  *stats[k][i].value = atoi(fields[j]);
+      }
+  }
+
+  fclose(f);
+  free(settings);
+  if (found)
+    printf("results for trace %s loaded from %s\n", fp, store);
+  return(found);
+}
+
+/* appends this run's statistics to the store */
+void save_results(char *store, char *trace_name)
+{
+  static char header[RESULTS_LINE_MAX], old[RESULTS_LINE_MAX];
+  char fp[17], *settings;
+  Pstat_entry stats;
+  FILE *f;
+  int n, i;
+
+  if (!fingerprint(trace_name, fp))
+    return;
+  f = fopen(store, "a+");
+  if (!f) {
+    printf("warning:  cannot open result store %s\n", store);
+    return;
+  }
+  flock(fileno(f), LOCK_EX);
+
+  header_text(header);
+  rewind(f);
+  if (!fgets(old, sizeof(old), f)) {
+    fprintf(f, "%s\n", header);
+  } else if (strncmp(old, header, strlen(header)) || old[strlen(header)] != '\n') {
+    printf("warning:  result store %s has other columns, not saved\n", store);
+    flock(fileno(f), LOCK_UN);
+    fclose(f);
+    return;
+  }
+
+  settings = settings_text();
+  fseek(f, 0, SEEK_END);
+  fprintf(f, "%s,%016llx,", fp, fnv1a(FNV_OFFSET, settings, strlen(settings)));
+  put_csv_string(f, trace_name);
+  stats = cache_stat_entries(&n);
+  for (i = 0; i < n; i++)
+    fprintf(f, ",%d", *stats[i].value);
+  stats = tlb_stat_entries(&n);
+  for (i = 0; i < n; i++)
+    fprintf(f, ",%d", *stats[i].value);
+  fputc(',', f);
+  put_csv_string(f, settings);
+  fputc('\n', f);
+
+  fflush(f);
+  flock(fileno(f), LOCK_UN);
+  fclose(f);
+  free(settings);
+}
+/************************************************************/
@@ -0,0 +1,24 @@
+/*
+ * results.h
+ *
+ * Persistent result store
+ */
+
+
+/* trace fingerprint: size plus sampled content */
+#define FP_SAMPLES 64
+#define FP_SAMPLE_SIZE 4096
+
+#define RESULTS_LINE_MAX 65536
+
+/* a statistic saved in the result store */
+typedef struct stat_entry_ {
+  char *name;			/* CSV column name */
+  int *value;
+} stat_entry, *Pstat_entry;
+
+/* function prototypes */
+Pstat_entry cache_stat_entries(int *n);
+Pstat_entry tlb_stat_entries(int *n);
+int find_results(char *store, char *trace_name);
+void save_results(char *store, char *trace_name);
@@ -0,0 +1,366 @@
+/*
+ * search.c
+ *
+ * Design-space search.  Explores unified cache size, block size and
+ * associativity under a size budget, an optional miss rate target and
+ * an optional traffic limit; every other setting stays as given on
+ * the command line.
+ *
+ * The trace is read once into memory.  For each block size a single
+ * pass computes the LRU stack distance of every reference, which gives
+ * the misses of a fully associative LRU cache of every size up to the
+ * budget at once.  These estimates discard sizes that miss the target
+ * or the traffic limit, and then any (size, block size) that another
+ * estimate beats in one of size, misses and traffic while matching it
+ * in the others.  Only the survivors are simulated, from direct mapped
+ * upwards, stopping once the misses are close to the fully associative
+ * estimate.  The Pareto frontier of the simulated configurations that
+ * meet the constraints is reported.
+ *
+ * The estimates ignore conflict misses, write-backs and sub-block
+ * fills, so they are a guide rather than a bound: a pruned point is
+ * very unlikely, but not certain, to have made the frontier.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "main.h"
+#include "trace.h"
+#include "tlb.h"
+#include "search.h"
+
+/* the trace, after address translation */
+static Ptrace_rec recs;
+static long n_recs;
+
+/* last reference time of each block, open addressing */
+static unsigned *map_block;
+static long *map_time;
+static int map_size, map_used;
+
+/* one marker per block at its last reference time */
+static int *fenwick;
+
+/************************************************************/
+static void out_of_memory()
+{
+  printf("error:  out of memory for the search trace\n");
+  exit(-1);
+}
+
+static unsigned map_hash(unsigned block)
+{
+  block *= 0x9e3779b1;
+  return(block ^ (block >> 16));
+}
+
+/* the last reference time slot of block, -1 if new */
+static long *map_slot(unsigned block)
+{
+  unsigned *old_block;
+  long *old_time;
+  int old_size, i, j;
+
+  if (2 * (map_used + 1) > map_size) {
+    old_block = map_block;
+    old_time = map_time;
+    old_size = map_size;
+    map_size = old_size ? 2 * old_size : SEARCH_MAP_INIT_SIZE;
+    map_block = (unsigned *)malloc(map_size * sizeof(unsigned));
+    map_time = (long *)malloc(map_size * sizeof(long));
+    if (!map_block || !map_time)
+      out_of_memory();
+    for (i = 0; i < map_size; i++)
+      map_time[i] = -1;
+    for (i = 0; i < old_size; i++)
+      if (old_time[i] >= 0) {
+	j = map_hash(old_block[i]) & (map_size - 1);
+	while (map_time[j] >= 0)
+	  j = (j + 1) & (map_size - 1);
+	map_block[j] = old_block[i];
+	map_time[j] = old_time[i];
+      }
+    free(old_block);
+    free(old_time);
+  }
+
+  i = map_hash(block) & (map_size - 1);
+  while (map_time[i] >= 0 && map_block[i] != block)
+    i = (i + 1) & (map_size - 1);
+  if (map_time[i] < 0) {
+    map_block[i] = block;
+    map_used++;
+  }
+  return(&map_time[i]);
+}
+
+static void fenwick_add(long i, int value)
+{
+  for (i++; i <= n_recs; i += i & -i)
+    fenwick[i] += value;
+}
+
+/* markers at times 0..i */
+static int fenwick_sum(long i)
+{
+  int sum = 0;
+
+  for (i++; i > 0; i -= i & -i)
+    sum += fenwick[i];
+  return(sum);
+}
+
+/* hist[d] counts references with d distinct blocks since the last
+   reference to their own block; hist[max_lines] also holds first
+   references and every distance of max_lines or more */
+static void miss_curve(int block_size, int max_lines, long *hist)
+{
+  unsigned block;
+  long *last, t;
+  int active = 0, d, i;
+
+  memset(hist, 0, (max_lines + 1) * sizeof(long));
+  memset(fenwick, 0, (n_recs + 1) * sizeof(int));
+  for (i = 0; i < map_size; i++)
+    map_time[i] = -1;
+  map_used = 0;
+
+  for (t = 0; t < n_recs; t++) {
+    block = recs[t].addr / block_size;
+    last = map_slot(block);
+    if (*last < 0) {
+      hist[max_lines]++;
+      active++;
+    } else {
+      d = active - fenwick_sum(*last);
+      hist[(d < max_lines) ? d : max_lines]++;
+      fenwick_add(*last, -1);
+    }
+    fenwick_add(t, 1);
+    *last = t;
+  }
+}
+
+/* a no worse than b everywhere and better somewhere */
+static int dominates(double *a, double *b, int n)
+{
+  int i, better = FALSE;
+
+  for (i = 0; i < n; i++) {
+    if (a[i] > b[i])
+      return(FALSE);
+    if (a[i] < b[i])
+      better = TRUE;
+  }
+  return(better);
+}
+
+static void simulate(Psearch_point p)
+{
+  int accesses;
+  long i;
+
+  reset_cache();
+  set_cache_param(CACHE_PARAM_USIZE, p->size);
+  set_cache_param(CACHE_PARAM_BLOCK_SIZE, p->block_size);
+  set_cache_param(CACHE_PARAM_ASSOC, p->assoc);
+  init_cache();
+
+  for (i = 0; i < n_recs; i++)
+    perform_access(recs[i].addr, recs[i].access_type);
+  flush();
+
+  cache_totals(&accesses, &p->misses, &p->traffic);
+}
+/************************************************************/
+
+/************************************************************/
+/* reads the whole trace into memory, translating addresses */
+void load_search_trace(FILE *inFile)
+{
+  unsigned addr, access_type;
+  long max_recs = SEARCH_INIT_RECS;
+
+  recs = (Ptrace_rec)malloc(max_recs * sizeof(trace_rec));
+  if (!recs)
+    out_of_memory();
+  n_recs = 0;
+  while (inFile ? read_trace_element(inFile, &access_type, &addr)
+	 : read_trace_record(&access_type, &addr)) {
+    switch (access_type) {
+    case TRACE_DATA_LOAD:
+    case TRACE_DATA_STORE:
+    case TRACE_INST_LOAD:
+      if (n_recs == max_recs) {
+	max_recs *= 2;
+	recs = (Ptrace_rec)realloc(recs, max_recs * sizeof(trace_rec));
+	if (!recs)
+	  out_of_memory();
+      }
+      recs[n_recs].access_type = access_type;
+      recs[n_recs].addr = translate(addr, access_type);
+      n_recs++;
+      break;
+
+    default:
+      printf("skipping access, unknown type(%d)\n", access_type);
+    }
+  }
+}
+
+void run_search(int budget, double target, int max_traffic)
+{
+  Psearch_point est, sim;
+  int n_est = 0, n_sim = 0, n_pruned[SEARCH_DOMINATED + 1];
+  long *hist;
+  int word_size, max_est, bs, size, lines, a, i, j;
+  double hits, cost[2][4];
+
+  word_size = get_cache_param(CACHE_PARAM_WORD_SIZE);
+  if (budget < SEARCH_MIN_SIZE) {
+    printf("error:  search budget %d is below %d bytes\n", budget,
+	   SEARCH_MIN_SIZE);
+    exit(-1);
+  }
+
+  if (!n_recs) {
+    printf("error:  empty trace\n");
+    exit(-1);
+  }
+
+  /* single pass estimates for every size and block size */
+  max_est = 0;
+  for (bs = SEARCH_MIN_BLOCK_SIZE; bs <= SEARCH_MAX_BLOCK_SIZE; bs *= 2)
+    for (size = SEARCH_MIN_SIZE; size <= budget; size *= 2)
+      max_est++;
+  est = (Psearch_point)calloc(max_est, sizeof(search_point));
+  sim = (Psearch_point)calloc(max_est * SEARCH_MAX_ASSOC, sizeof(search_point));
+  fenwick = (int *)malloc((n_recs + 1) * sizeof(int));
+  hist = (long *)malloc((budget / SEARCH_MIN_BLOCK_SIZE + 1) * sizeof(long));
+  if (!est || !sim || !fenwick || !hist)
+    out_of_memory();
+
+  for (bs = SEARCH_MIN_BLOCK_SIZE; bs <= SEARCH_MAX_BLOCK_SIZE; bs *= 2) {
+    miss_curve(bs, budget / bs, hist);
+    hits = 0;
+    lines = 0;
+    for (size = SEARCH_MIN_SIZE; size <= budget; size *= 2) {
+      for (; lines < size / bs; lines++)
+	hits += hist[lines];
+      est[n_est].size = size;
+      est[n_est].block_size = bs;
+      est[n_est].est_misses = n_recs - hits;
+      est[n_est].est_traffic = est[n_est].est_misses * (bs / word_size);
+      n_est++;
+    }
+  }
+
+  /* prune on the estimates */
+  memset(n_pruned, 0, sizeof(n_pruned));
+  for (i = 0; i < n_est; i++) {
+    if (est[i].est_misses > target * n_recs)
+      est[i].pruned = SEARCH_OVER_TARGET;
+    else if (max_traffic > 0 && est[i].est_traffic > max_traffic)
+      est[i].pruned = SEARCH_OVER_TRAFFIC;
+  }
+  for (i = 0; i < n_est; i++) {
+    if (est[i].pruned)
+      continue;
+    cost[0][0] = est[i].size;
+    cost[0][1] = est[i].est_misses;
+    cost[0][2] = est[i].est_traffic;
+    for (j = 0; j < n_est; j++) {
+      if (j == i || est[j].pruned == SEARCH_OVER_TARGET ||
+	  est[j].pruned == SEARCH_OVER_TRAFFIC)
+	continue;
+      cost[1][0] = est[j].size;
+      cost[1][1] = est[j].est_misses;
+      cost[1][2] = est[j].est_traffic;
+      if (dominates(cost[1], cost[0], 3))
+	break;
+    }
+    if (j < n_est)
+      est[i].pruned = SEARCH_DOMINATED;
+  }
+
+  /* simulate the survivors */
+  for (i = 0; i < n_est; i++) {
+    n_pruned[est[i].pruned]++;
+    if (est[i].pruned)
+      continue;
+    lines = est[i].size / est[i].block_size;
+    for (a = 1; a <= SEARCH_MAX_ASSOC && a <= lines; a *= 2) {
+      sim[n_sim] = est[i];
+      sim[n_sim].assoc = a;
+      simulate(&sim[n_sim]);
+      printf("simulated size %d block %d assoc %d:  %d misses\n",
+	     sim[n_sim].size, sim[n_sim].block_size, a, sim[n_sim].misses);
+      n_sim++;
+      if (sim[n_sim - 1].misses <=
+	  est[i].est_misses * (1.0 + SEARCH_ASSOC_SLACK))
+	break;
+    }
+  }
+
+  /* frontier of the feasible simulated points */
+  for (i = 0; i < n_sim; i++) {
+    if (sim[i].misses > target * n_recs ||
+	(max_traffic > 0 && sim[i].traffic > max_traffic))
+      continue;
+    cost[0][0] = sim[i].size;
+    cost[0][1] = sim[i].assoc;
+    cost[0][2] = sim[i].misses;
+    cost[0][3] = sim[i].traffic;
+    sim[i].frontier = TRUE;
+    for (j = 0; j < n_sim && sim[i].frontier; j++) {
+      if (j == i || sim[j].misses > target * n_recs ||
+	  (max_traffic > 0 && sim[j].traffic > max_traffic))
+	continue;
+      cost[1][0] = sim[j].size;
+      cost[1][1] = sim[j].assoc;
+      cost[1][2] = sim[j].misses;
+      cost[1][3] = sim[j].traffic;
+      if (dominates(cost[1], cost[0], 4))
+	sim[i].frontier = FALSE;
+    }
+  }
+
+  printf("*** DESIGN SPACE SEARCH ***\n");
+  printf("  references:  %ld\n", n_recs);
+  printf("  size budget: %d\n", budget);
+  if (target < 1.0)
+    printf("  target miss rate: %f\n", target);
+  if (max_traffic > 0)
+    printf("  traffic limit: %d words\n", max_traffic);
+  printf("  ESTIMATES (size x block size)\n");
+  printf("  candidates:  %d\n", n_est);
+  printf("  over target: %d\n", n_pruned[SEARCH_OVER_TARGET]);
+  printf("  over traffic: %d\n", n_pruned[SEARCH_OVER_TRAFFIC]);
+  printf("  dominated:   %d\n", n_pruned[SEARCH_DOMINATED]);
+  printf("  simulated:   %d\n", n_sim);
+
+  printf("  PARETO FRONTIER\n");
+  printf("  %8s %6s %6s %10s %10s %10s\n", "size", "block", "assoc",
+	 "misses", "miss rate", "traffic");
+  for (i = 0, j = 0; i < n_sim; i++) {
+    if (!sim[i].frontier)
+      continue;
+    printf("  %8d %6d %6d %10d %10f %10d\n", sim[i].size, sim[i].block_size,
+	   sim[i].assoc, sim[i].misses, (float)sim[i].misses / (float)n_recs,
+	   sim[i].traffic);
+    j++;
+  }
+  if (!j)
+    printf("  no simulated configuration meets the constraints\n");
+
+  free(hist);
+  free(fenwick);
+  free(sim);
+  free(est);
+  free(recs);
+}
+/************************************************************/
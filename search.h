@@ -0,0 +1,46 @@
+/*
+ * search.h
+ *
+ * Design-space search
+ */
+
+
+/* default search constraints--can be changed */
+#define DEFAULT_SEARCH_BUDGET (64 * 1024)
+#define DEFAULT_SEARCH_TARGET 1.0	/* miss rate, 1.0: unconstrained */
+#define DEFAULT_SEARCH_TRAFFIC 0	/* words, 0: unconstrained */
+
+/* explored space: unified size x block size x associativity */
+#define SEARCH_MIN_SIZE 1024
+#define SEARCH_MIN_BLOCK_SIZE 16
+#define SEARCH_MAX_BLOCK_SIZE 128
+#define SEARCH_MAX_ASSOC 8
+
+/* stop raising associativity once misses are this close to the estimate */
+#define SEARCH_ASSOC_SLACK 0.01
+
+/* why a candidate was not simulated */
+#define SEARCH_KEPT 0
+#define SEARCH_OVER_TARGET 1	/* estimated miss rate above the target */
+#define SEARCH_OVER_TRAFFIC 2	/* estimated traffic above the limit */
+#define SEARCH_DOMINATED 3	/* another estimate is no worse everywhere */
+
+#define SEARCH_INIT_RECS (1024 * 1024)
+#define SEARCH_MAP_INIT_SIZE 4096
+
+/* structure definitions */
+typedef struct search_point_ {
+  int size;			/* unified cache size in bytes */
+  int block_size;		/* block size in bytes */
+  int assoc;			/* associativity, 0 for an estimate */
+  double est_misses;		/* fully associative LRU misses */
+  double est_traffic;		/* words fetched by est_misses */
+  int pruned;			/* SEARCH_KEPT or why it was dropped */
+  int misses;			/* simulated misses */
+  int traffic;			/* simulated words to and from memory */
+  int frontier;			/* on the simulated Pareto frontier */
+} search_point, *Psearch_point;
+
+/* function prototypes */
+void load_search_trace(FILE *inFile);
+void run_search(int budget, double target, int max_traffic);
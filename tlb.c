@@ -0,0 +1,381 @@
+/*
+ * tlb.c
+ *
+ * TLB and virtual-to-physical page mapping model.  When enabled, trace
+ * addresses are treated as virtual: each reference looks up its page
+ * in a split first level I/D TLB and an optional shared second level
+ * TLB, and is then mapped to a physical address before it reaches the
+ * caches.  Physical frames are handed out on first touch, either in
+ * order or in a fixed scattered order, so runs are deterministic.
+ * Huge pages come from the upper half of physical memory and base
+ * pages from the lower half, so the two never overlap.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "main.h"
+#include "tlb.h"
+#include "results.h"
+
+/* TLB configuration parameters */
+static int tlb_entries = DEFAULT_TLB_ENTRIES;
+static int tlb_assoc = DEFAULT_TLB_ASSOC;
+static int tlb2_entries = DEFAULT_TLB2_ENTRIES;
+static int tlb2_assoc = DEFAULT_TLB2_ASSOC;
+static int page_size = DEFAULT_PAGE_SIZE;
+static int huge_page_size = DEFAULT_HUGE_PAGE_SIZE;
+static int huge_pages = DEFAULT_HUGE_PAGES;
+static int page_map_policy = DEFAULT_PAGE_MAP;
+
+/* TLB model data structures */
+static tlb itlb;
+static tlb dtlb;
+static tlb tlb2;
+static tlb_stat tlb_stat_inst;
+static tlb_stat tlb_stat_data;
+static tlb_stat tlb_stat_l2;
+static unsigned tlb_clock = 0;
+static int page_walks = 0;
+static int base_shift;			/* log2 of the page sizes */
+static int huge_shift;
+
+/* page table */
+static Ppage_map_entry page_map;
+static int page_map_size;		/* slots, a power of two */
+static int page_map_used;
+static int base_frames = 0;		/* base pages allocated */
+static int huge_frames = 0;		/* huge pages allocated */
+
+/* statistics kept in the result store, in column order */
+static stat_entry tlb_stat_table[] = {
+  { "itlb_accesses", &tlb_stat_inst.accesses },
+  { "itlb_misses", &tlb_stat_inst.misses },
+  { "dtlb_accesses", &tlb_stat_data.accesses },
+  { "dtlb_misses", &tlb_stat_data.misses },
+  { "l2tlb_accesses", &tlb_stat_l2.accesses },
+  { "l2tlb_misses", &tlb_stat_l2.misses },
+  { "page_walks", &page_walks },
+  { "base_pages", &base_frames },
+  { "huge_pages", &huge_frames },
+};
+
+/************************************************************/
+void set_tlb_param(int param, int value)
+{
+  switch (param) {
+  case TLB_PARAM_ENTRIES:
+    tlb_entries = value;
+    break;
+  case TLB_PARAM_ASSOC:
+    tlb_assoc = value;
+    break;
+  case TLB_PARAM_L2_ENTRIES:
+    tlb2_entries = value;
+    break;
+  case TLB_PARAM_L2_ASSOC:
+    tlb2_assoc = value;
+    break;
+  case TLB_PARAM_PAGE_SIZE:
+    page_size = value;
+    break;
+  case TLB_PARAM_HUGE_PAGE_SIZE:
+    huge_page_size = value;
+    break;
+  case TLB_PARAM_HUGE_PAGES:
+    huge_pages = value;
+    break;
+  case TLB_PARAM_PAGE_MAP:
+    page_map_policy = value;
+    break;
+  default:
+    printf("error set_tlb_param: bad parameter value\n");
+    exit(-1);
+  }
+
+}
+/************************************************************/
+
+/************************************************************/
+static void init_one_tlb(Ptlb t, int size, int assoc)
+{
+	if (assoc <= 0 || assoc > size)
+		assoc = size;
+	t->size = size;
+	t->associativity = assoc;
+	t->n_sets = size / assoc;
+	t->entries = (Ptlb_entry)malloc(sizeof(tlb_entry)*size);
+	memset(t->entries, 0, sizeof(tlb_entry)*size);
+}
+
+static int is_pow2(int x)
+{
+	return(x > 0 && (x & (x - 1)) == 0);
+}
+
+static int log2_int(int x)
+{
+	int n;
+
+	for (n = 0; x > 1; x >>= 1)
+		n ++;
+	return(n);
+}
+
+void init_tlb()
+{
+	/* initialize the TLBs and the page table */
+	if (tlb_entries <= 0)
+		return;
+
+	if (!is_pow2(page_size) || !is_pow2(huge_page_size) ||
+	    huge_page_size < page_size) {
+		printf("error init_tlb: page sizes %d and %d must be powers of two, huge >= base\n",
+		       page_size, huge_page_size);
+		exit(-1);
+	}
+	/* the page map marks unused slots with a zero page shift */
+	if (page_size < MIN_PAGE_SIZE) {
+		printf("error init_tlb: page size %d is below %d bytes\n",
+		       page_size, MIN_PAGE_SIZE);
+		exit(-1);
+	}
+
+	base_shift = log2_int(page_size);
+	huge_shift = log2_int(huge_page_size);
+
+	init_one_tlb(&itlb, tlb_entries, tlb_assoc);
+	init_one_tlb(&dtlb, tlb_entries, tlb_assoc);
+	if (tlb2_entries > 0)
+		init_one_tlb(&tlb2, tlb2_entries, tlb2_assoc);
+
+	page_map_size = PAGE_MAP_INIT_SIZE;
+	page_map = (Ppage_map_entry)malloc(sizeof(page_map_entry)*page_map_size);
+	memset(page_map, 0, sizeof(page_map_entry)*page_map_size);
+}
+/************************************************************/
+
+/************************************************************/
+/* returns TRUE on a hit; a miss installs the page over the LRU way */
+static int tlb_access(Ptlb t, unsigned vpn, int page_shift)
+{
+	Ptlb_entry set, victim = NULL;
+	int w;
+
+	/* index with the page number, mixing in the page size */
+	set = &t->entries[((vpn ^ page_shift) % t->n_sets) * t->associativity];
+	for (w = 0; w < t->associativity; w++)
+		if (set[w].valid && set[w].vpn == vpn && set[w].page_shift == page_shift) {
+			set[w].last_use = ++tlb_clock;
+			return(TRUE);
+		}
+
+	for (w = 0; w < t->associativity; w++) {
+		if (!set[w].valid) {
+			victim = &set[w];
+			break;
+		}
+		if (!victim || set[w].last_use < victim->last_use)
+			victim = &set[w];
+	}
+	victim->vpn = vpn;
+	victim->page_shift = page_shift;
+	victim->valid = TRUE;
+	victim->last_use = ++tlb_clock;
+	return(FALSE);
+}
+
+static unsigned page_hash(unsigned vpn, int page_shift)
+{
+	return((vpn * 2654435761u) ^ page_shift);
+}
+
+/*
+ * the n-th frame of a region of 2^bits frames; PMAP_SCATTER permutes
+ * n with odd multiplies and xor-shifts, all invertible modulo 2^bits,
+ * so no frame is handed out twice until the region wraps
+ */
+static unsigned pick_frame(unsigned n, int bits)
+{
+	unsigned mask = (bits >= 32) ? ~0u : (1u << bits) - 1;
+	int half = (bits + 1) / 2;
+
+	n &= mask;
+	if (page_map_policy == PMAP_SCATTER) {
+		n = (n * 0x9e3779b1u) & mask;
+		n ^= n >> half;
+		n = (n * 0x85ebca6bu) & mask;
+		n ^= n >> half;
+	}
+	return(n);
+}
+
+static unsigned alloc_frame(int page_shift)
+{
+	/* 32 bit physical addresses; huge pages take the upper half */
+	int bits = 31 - page_shift;
+
+	if (page_shift == huge_shift && huge_shift != base_shift)
+		return((1u << bits) | pick_frame(huge_frames++, bits));
+	return(pick_frame(base_frames++, bits));
+}
+
+static void grow_page_map()
+{
+	Ppage_map_entry old = page_map;
+	int old_size = page_map_size, i, j;
+
+	page_map_size *= 2;
+	page_map = (Ppage_map_entry)malloc(sizeof(page_map_entry)*page_map_size);
+	memset(page_map, 0, sizeof(page_map_entry)*page_map_size);
+	for (i = 0; i < old_size; i++) {
+		if (!old[i].page_shift)
+			continue;
+		j = page_hash(old[i].vpn, old[i].page_shift) & (page_map_size - 1);
+		while (page_map[j].page_shift)
+			j = (j + 1) & (page_map_size - 1);
+		page_map[j] = old[i];
+	}
+	free(old);
+}
+
+/* physical frame of a virtual page, allocated on first touch */
+static unsigned page_lookup(unsigned vpn, int page_shift)
+{
+	int j = page_hash(vpn, page_shift) & (page_map_size - 1);
+
+	while (page_map[j].page_shift) {
+		if (page_map[j].vpn == vpn && page_map[j].page_shift == page_shift)
+			return(page_map[j].pfn);
+		j = (j + 1) & (page_map_size - 1);
+	}
+
+	page_map[j].vpn = vpn;
+	page_map[j].page_shift = page_shift;
+	page_map[j].pfn = alloc_frame(page_shift);
+	page_map_used ++;
+	if (2 * page_map_used > page_map_size) {
+		unsigned pfn = page_map[j].pfn;
+		grow_page_map();
+		return(pfn);
+	}
+	return(page_map[j].pfn);
+}
+
+unsigned translate(unsigned addr, unsigned access_type)
+{
+	/* map a trace address to the physical address the caches see */
+	int huge, page_shift;
+	unsigned vpn;
+	Ptlb l1;
+	Ptlb_stat l1_stat;
+
+	if (tlb_entries <= 0)
+		return(addr);
+
+	if (access_type == TRACE_INST_LOAD) {
+		huge = huge_pages & HUGE_INST;
+		l1 = &itlb;
+		l1_stat = &tlb_stat_inst;
+	} else {
+		huge = huge_pages & HUGE_DATA;
+		l1 = &dtlb;
+		l1_stat = &tlb_stat_data;
+	}
+	page_shift = huge ? huge_shift : base_shift;
+	vpn = addr >> page_shift;
+
+	l1_stat->accesses ++;
+	if (!tlb_access(l1, vpn, page_shift)) {
+		l1_stat->misses ++;
+		if (tlb2_entries > 0) {
+			tlb_stat_l2.accesses ++;
+			if (!tlb_access(&tlb2, vpn, page_shift)) {
+				tlb_stat_l2.misses ++;
+				page_walks ++;
+			}
+		} else {
+			page_walks ++;
+		}
+	}
+
+	return((page_lookup(vpn, page_shift) << page_shift) |
+	       (addr & ((1u << page_shift) - 1)));
+}
+/************************************************************/
+
+/************************************************************/
+void fdump_tlb_settings(FILE *out)
+{
+  if (tlb_entries <= 0)
+    return;
+
+  fprintf(out, "TLB Settings:\n");
+  fprintf(out, "\tI-/D-TLB entries: \t%d\n", tlb_entries);
+  fprintf(out, "\tI-/D-TLB associativity: \t%d\n",
+	       (tlb_assoc <= 0 || tlb_assoc > tlb_entries) ? tlb_entries : tlb_assoc);
+  if (tlb2_entries > 0) {
+    fprintf(out, "\tL2 TLB entries: \t%d\n", tlb2_entries);
+    fprintf(out, "\tL2 TLB associativity: \t%d\n",
+	         (tlb2_assoc <= 0 || tlb2_assoc > tlb2_entries) ? tlb2_entries : tlb2_assoc);
+  }
+  fprintf(out, "\tPage size: \t%d\n", page_size);
+  fprintf(out, "\tHuge page size: \t%d\n", huge_page_size);
+  fprintf(out, "\tHuge pages: \t%s\n",
+	       (huge_pages == (HUGE_INST | HUGE_DATA)) ? "INSTRUCTIONS AND DATA" :
+	       (huge_pages == HUGE_INST) ? "INSTRUCTIONS" :
+	       (huge_pages == HUGE_DATA) ? "DATA" : "NONE");
+  fprintf(out, "\tPage allocation: \t%s\n",
+	       (page_map_policy == PMAP_SCATTER) ? "SCATTERED" : "SEQUENTIAL");
+}
+
+void dump_tlb_settings()
+{
+  fdump_tlb_settings(stdout);
+}
+/************************************************************/
+
+/************************************************************/
+void print_tlb_stats()
+{
+  if (tlb_entries <= 0)
+    return;
+
+  printf("*** TLB STATISTICS ***\n");
+  printf("  I-TLB\n");
+  printf("  accesses:  %d\n", tlb_stat_inst.accesses);
+  printf("  misses:    %d\n", tlb_stat_inst.misses);
+  printf("  miss rate: %f\n",
+	 (float)tlb_stat_inst.misses / (float)tlb_stat_inst.accesses);
+
+  printf("  D-TLB\n");
+  printf("  accesses:  %d\n", tlb_stat_data.accesses);
+  printf("  misses:    %d\n", tlb_stat_data.misses);
+  printf("  miss rate: %f\n",
+	 (float)tlb_stat_data.misses / (float)tlb_stat_data.accesses);
+
+  if (tlb2_entries > 0) {
+    printf("  L2 TLB\n");
+    printf("  accesses:  %d\n", tlb_stat_l2.accesses);
+    printf("  misses:    %d\n", tlb_stat_l2.misses);
+    printf("  miss rate: %f\n",
+	   (float)tlb_stat_l2.misses / (float)tlb_stat_l2.accesses);
+  }
+
+  printf("  PAGES\n");
+  printf("  page walks:  %d\n", page_walks);
+  printf("  base pages:  %d\n", base_frames);
+  printf("  huge pages:  %d\n", huge_frames);
+}
+/************************************************************/
+
+/************************************************************/
+Pstat_entry tlb_stat_entries(int *n)
+{
+  *n = sizeof(tlb_stat_table) / sizeof(tlb_stat_table[0]);
+  return(tlb_stat_table);
+}
+/************************************************************/
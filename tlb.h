@@ -0,0 +1,73 @@
+/*
+ * tlb.h
+ *
+ * TLB and virtual-to-physical page mapping model
+ */
+
+
+/* default TLB parameters--can be changed */
+#define DEFAULT_TLB_ENTRIES 0		/* 0: addresses are physical */
+#define DEFAULT_TLB_ASSOC 4
+#define DEFAULT_TLB2_ENTRIES 0		/* 0: no second level TLB */
+#define DEFAULT_TLB2_ASSOC 8
+#define DEFAULT_PAGE_SIZE 4096
+#define MIN_PAGE_SIZE 256
+#define DEFAULT_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define DEFAULT_HUGE_PAGES 0
+#define DEFAULT_PAGE_MAP PMAP_SEQ
+
+/* streams mapped with huge pages */
+#define HUGE_DATA 1
+#define HUGE_INST 2
+
+/* physical page allocation policies */
+#define PMAP_SEQ 0		/* frames in first-touch order */
+#define PMAP_SCATTER 1		/* frames in a fixed pseudo-random order */
+
+/* constants for setting TLB parameters */
+#define TLB_PARAM_ENTRIES 0
+#define TLB_PARAM_ASSOC 1
+#define TLB_PARAM_L2_ENTRIES 2
+#define TLB_PARAM_L2_ASSOC 3
+#define TLB_PARAM_PAGE_SIZE 4
+#define TLB_PARAM_HUGE_PAGE_SIZE 5
+#define TLB_PARAM_HUGE_PAGES 6
+#define TLB_PARAM_PAGE_MAP 7
+
+#define PAGE_MAP_INIT_SIZE 4096
+
+
+/* structure definitions */
+typedef struct tlb_entry_ {
+  unsigned vpn;			/* virtual page number */
+  int page_shift;		/* log2 of the page size */
+  int valid;
+  unsigned last_use;		/* LRU timestamp */
+} tlb_entry, *Ptlb_entry;
+
+typedef struct tlb_ {
+  int size;			/* number of entries */
+  int associativity;		/* TLB associativity */
+  int n_sets;			/* number of TLB sets */
+  Ptlb_entry entries;		/* way w of set s at [s * associativity + w] */
+} tlb, *Ptlb;
+
+typedef struct tlb_stat_ {
+  int accesses;			/* number of lookups */
+  int misses;			/* number of TLB misses */
+} tlb_stat, *Ptlb_stat;
+
+typedef struct page_map_entry_ {
+  unsigned vpn;			/* virtual page number */
+  int page_shift;		/* log2 of the page size, 0 if unused */
+  unsigned pfn;			/* physical frame number */
+} page_map_entry, *Ppage_map_entry;
+
+
+/* function prototypes */
+void set_tlb_param(int param, int value);
+void init_tlb();
+unsigned translate(unsigned addr, unsigned access_type);
+void dump_tlb_settings();
+void fdump_tlb_settings(FILE *out);
+void print_tlb_stats();
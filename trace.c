@@ -0,0 +1,727 @@
+/*
+ * trace.c
+ *
+ * Trace file input.  Traces may be named files, named pipes, or
+ * standard input ("-"), and may be gzip, zstd or xz compressed.  The
+ * encoding is detected from the leading magic bytes.  Compressed
+ * traces are decoded on a background thread when the library was
+ * compiled in (HAVE_ZLIB, HAVE_ZSTD, HAVE_LZMA), and piped through the
+ * external gzip/zstd/xz tool otherwise.  Either way the simulator
+ * reads plain text from the returned stream.
+ *
+ * Large uncompressed text traces can instead be memory mapped and
+ * parsed by several threads.  The file is split into newline-aligned
+ * chunks which worker threads decode into record buffers; the
+ * simulator consumes the buffers strictly in trace order.  Both
+ * readers decode lines with parse_trace_line(), so results are
+ * identical to the serial reader.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#include "trace.h"
+
+/* external decompressors, indexed by TRACE_FMT_* */
+static char *trace_tools[] = { NULL, "gzip", "zstd", "xz" };
+
+/* trace source state */
+static int src_fd = -1;
+static unsigned char src_magic[TRACE_MAGIC_LEN];
+static int src_magic_len = 0;
+static int src_magic_pos = 0;
+
+/* background decoder / feeder thread */
+static pthread_t pump_thread;
+static int pump_running = 0;
+static int pump_fmt;
+static int pump_out_fd = -1;
+static int pump_failed;			/* decode or read error */
+
+/* external decompressor process */
+static pid_t tool_pid = -1;
+
+/* parallel loader state */
+static char *map_base = NULL;
+static size_t map_size = 0;
+static long n_chunks;			/* chunks in the mapped file */
+static long next_parse;			/* next chunk to hand to a worker */
+static long next_consume;		/* next chunk the simulator reads */
+static int stop_workers;
+static int n_workers;
+static pthread_t *workers;
+static Ptrace_chunk slots;		/* chunk k lives in slot k % n_slots */
+static int n_slots;
+static Ptrace_chunk cur_chunk = NULL;
+static int cur_rec;
+static pthread_mutex_t chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t chunk_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t chunk_free = PTHREAD_COND_INITIALIZER;
+
+/************************************************************/
+/* reads from the trace source, replaying the sniffed magic bytes first */
+static ssize_t src_read(void *buf, size_t len)
+{
+  ssize_t n;
+
+  if (src_magic_pos < src_magic_len) {
+    n = src_magic_len - src_magic_pos;
+    if (n > len)
+      n = len;
+    memcpy(buf, src_magic + src_magic_pos, n);
+    src_magic_pos += n;
+    return(n);
+  }
+
+  do {
+    n = read(src_fd, buf, len);
+  } while (n < 0 && errno == EINTR);
+
+  return(n);
+}
+
+static int write_all(int fd, void *buf, size_t len)
+{
+  char *p = (char *)buf;
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      return(-1);
+    }
+    p += n;
+    len -= n;
+  }
+
+  return(0);
+}
+/************************************************************/
+
+/************************************************************/
+static int pump_copy()
+{
+  static char in[TRACE_IO_BUF];
+  ssize_t n;
+
+  while ((n = src_read(in, sizeof(in))) > 0)
+    if (write_all(pump_out_fd, in, n))
+      return(-1);
+
+  return((n < 0) ? -1 : 0);
+}
+
+#ifdef HAVE_ZLIB
+static int pump_gzip()
+{
+  static unsigned char in[TRACE_IO_BUF], out[TRACE_IO_BUF];
+  z_stream z;
+  ssize_t n;
+  int ret = Z_OK, result = 0;
+
+  memset(&z, 0, sizeof(z));
+  /* 15 window bits, +32 to accept both gzip and zlib headers */
+  if (inflateInit2(&z, 15 + 32) != Z_OK)
+    return(-1);
+
+  while (result == 0) {
+    if (z.avail_in == 0) {
+      n = src_read(in, sizeof(in));
+      if (n <= 0) {
+	if (n < 0 || ret != Z_STREAM_END)
+	  result = -1;
+	break;
+      }
+      z.next_in = in;
+      z.avail_in = n;
+    }
+
+    /* concatenated gzip members decode as one stream */
+    if (ret == Z_STREAM_END)
+      inflateReset(&z);
+
+    z.next_out = out;
+    z.avail_out = sizeof(out);
+    ret = inflate(&z, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+      result = -1;
+    else if (write_all(pump_out_fd, out, sizeof(out) - z.avail_out))
+      result = -1;
+  }
+
+  inflateEnd(&z);
+  return(result);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int pump_zstd()
+{
+  static char in[TRACE_IO_BUF], out[TRACE_IO_BUF];
+  ZSTD_DStream *zs;
+  ZSTD_inBuffer zin;
+  ZSTD_outBuffer zout;
+  ssize_t n;
+  size_t ret = 0;
+  int result = 0;
+
+  zs = ZSTD_createDStream();
+  if (!zs || ZSTD_isError(ZSTD_initDStream(zs)))
+    return(-1);
+
+  while (result == 0 && (n = src_read(in, sizeof(in))) > 0) {
+    zin.src = in;
+    zin.size = n;
+    zin.pos = 0;
+    while (zin.pos < zin.size) {
+      zout.dst = out;
+      zout.size = sizeof(out);
+      zout.pos = 0;
+      ret = ZSTD_decompressStream(zs, &zout, &zin);
+      if (ZSTD_isError(ret) || write_all(pump_out_fd, out, zout.pos)) {
+	result = -1;
+	break;
+      }
+    }
+  }
+  /* a nonzero hint at end of input means the last frame is incomplete */
+  if (n < 0 || (result == 0 && ret != 0))
+    result = -1;
+
+  ZSTD_freeDStream(zs);
+  return(result);
+}
+#endif
+
+#ifdef HAVE_LZMA
+static int pump_xz()
+{
+  static unsigned char in[TRACE_IO_BUF], out[TRACE_IO_BUF];
+  lzma_stream xz = LZMA_STREAM_INIT;
+  lzma_action action = LZMA_RUN;
+  lzma_ret ret;
+  ssize_t n;
+  int result = 0;
+
+  if (lzma_stream_decoder(&xz, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+    return(-1);
+
+  while (result == 0) {
+    if (xz.avail_in == 0 && action == LZMA_RUN) {
+      n = src_read(in, sizeof(in));
+      if (n < 0) {
+	result = -1;
+	break;
+      }
+      if (n == 0)
+	action = LZMA_FINISH;
+      xz.next_in = in;
+      xz.avail_in = n;
+    }
+
+    xz.next_out = out;
+    xz.avail_out = sizeof(out);
+    ret = lzma_code(&xz, action);
+    if (write_all(pump_out_fd, out, sizeof(out) - xz.avail_out))
+      result = -1;
+    if (ret == LZMA_STREAM_END)
+      break;
+    if (ret != LZMA_OK)
+      result = -1;
+  }
+
+  lzma_end(&xz);
+  return(result);
+}
+#endif
+
+static void *pump(void *arg)
+{
+  int result;
+
+  switch (pump_fmt) {
+#ifdef HAVE_ZLIB
+  case TRACE_FMT_GZIP:
+    result = pump_gzip();
+    break;
+#endif
+#ifdef HAVE_ZSTD
+  case TRACE_FMT_ZSTD:
+    result = pump_zstd();
+    break;
+#endif
+#ifdef HAVE_LZMA
+  case TRACE_FMT_XZ:
+    result = pump_xz();
+    break;
+#endif
+  default:
+    result = pump_copy();
+  }
+
+  /* a closed reader (EPIPE) just means the simulator stopped early */
+  if (result && errno != EPIPE)
+    pump_failed = 1;
+
+  close(pump_out_fd);
+  return(NULL);
+}
+
+/* starts the pump thread; returns the read end of its output pipe */
+static int start_pump(int fmt)
+{
+  int fds[2];
+
+  if (pipe(fds)) {
+    printf("error:  cannot create trace pipe\n");
+    exit(-1);
+  }
+
+  pump_fmt = fmt;
+  pump_out_fd = fds[1];
+  pump_failed = 0;
+  if (pthread_create(&pump_thread, NULL, pump, NULL)) {
+    printf("error:  cannot start trace decoder thread\n");
+    exit(-1);
+  }
+  pump_running = 1;
+
+  return(fds[0]);
+}
+/************************************************************/
+
+/************************************************************/
+static int have_decoder(int fmt)
+{
+  switch (fmt) {
+#ifdef HAVE_ZLIB
+  case TRACE_FMT_GZIP:
+    return(1);
+#endif
+#ifdef HAVE_ZSTD
+  case TRACE_FMT_ZSTD:
+    return(1);
+#endif
+#ifdef HAVE_LZMA
+  case TRACE_FMT_XZ:
+    return(1);
+#endif
+  default:
+    return(0);
+  }
+}
+
+/* runs "<tool> -dc" with the trace on stdin; returns its stdout pipe */
+static int start_tool(int fmt, int seekable)
+{
+  int in_fd, feed_fd = -1, out[2];
+
+  if (seekable) {
+    lseek(src_fd, 0, SEEK_SET);
+    in_fd = src_fd;
+  } else {
+    /* the sniffed bytes are already consumed; feed them back in */
+    in_fd = start_pump(TRACE_FMT_TEXT);
+    feed_fd = pump_out_fd;
+  }
+
+  if (pipe(out)) {
+    printf("error:  cannot create trace pipe\n");
+    exit(-1);
+  }
+
+  fflush(stdout);
+  tool_pid = fork();
+  if (tool_pid < 0) {
+    printf("error:  cannot start %s\n", trace_tools[fmt]);
+    exit(-1);
+  }
+
+  if (tool_pid == 0) {
+    dup2(in_fd, 0);
+    dup2(out[1], 1);
+    close(out[0]);
+    close(out[1]);
+    if (!seekable) {
+      /* the tool must not hold its own input pipe open */
+      close(in_fd);
+      close(feed_fd);
+    }
+    execlp(trace_tools[fmt], trace_tools[fmt], "-dc", (char *)NULL);
+    fprintf(stderr, "error:  cannot run %s to decompress trace\n",
+	    trace_tools[fmt]);
+    _exit(127);
+  }
+
+  close(out[1]);
+  if (!seekable)
+    close(in_fd);
+
+  return(out[0]);
+}
+
+static int sniff_format()
+{
+  ssize_t n;
+
+  while (src_magic_len < TRACE_MAGIC_LEN) {
+    n = read(src_fd, src_magic + src_magic_len,
+	     TRACE_MAGIC_LEN - src_magic_len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    src_magic_len += n;
+  }
+
+  if (src_magic_len >= 2 && src_magic[0] == 0x1f && src_magic[1] == 0x8b)
+    return(TRACE_FMT_GZIP);
+  if (src_magic_len >= 4 && !memcmp(src_magic, "\x28\xb5\x2f\xfd", 4))
+    return(TRACE_FMT_ZSTD);
+  if (src_magic_len >= 6 && !memcmp(src_magic, "\xfd" "7zXZ\0", 6))
+    return(TRACE_FMT_XZ);
+
+  return(TRACE_FMT_TEXT);
+}
+/************************************************************/
+
+/************************************************************/
+FILE *open_trace(char *name)
+{
+  struct stat st;
+  int fmt, seekable, fd;
+  FILE *inFile;
+
+  if (!strcmp(name, TRACE_STDIN))
+    src_fd = 0;
+  else
+    src_fd = open(name, O_RDONLY);
+
+  if (src_fd < 0 || fstat(src_fd, &st)) {
+    printf("error:  cannot open trace file %s: %s\n", name, strerror(errno));
+    exit(-1);
+  }
+  src_magic_len = src_magic_pos = 0;
+  seekable = S_ISREG(st.st_mode);
+
+  /* a decoder that hits a closed pipe should see EPIPE, not die */
+  signal(SIGPIPE, SIG_IGN);
+
+  fmt = sniff_format();
+  if (fmt == TRACE_FMT_TEXT && seekable) {
+    lseek(src_fd, 0, SEEK_SET);
+    fd = src_fd;
+  } else if (fmt == TRACE_FMT_TEXT || have_decoder(fmt)) {
+    fd = start_pump(fmt);
+  } else {
+    fd = start_tool(fmt, seekable);
+  }
+
+  inFile = fdopen(fd, "r");
+  if (!inFile) {
+    printf("error:  cannot read trace file %s\n", name);
+    exit(-1);
+  }
+
+  return(inFile);
+}
+
+/* returns -1 if the trace could not be read or decoded to the end */
+int close_trace(FILE *inFile)
+{
+  int status, result = 0;
+
+  /* a plain seekable trace is read straight from the source */
+  if (fileno(inFile) == src_fd)
+    src_fd = -1;
+  fclose(inFile);
+
+  if (pump_running) {
+    pthread_join(pump_thread, NULL);
+    pump_running = 0;
+    if (pump_failed)
+      result = -1;
+  }
+
+  if (tool_pid > 0) {
+    waitpid(tool_pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+      result = -1;
+    tool_pid = -1;
+  }
+
+  if (src_fd > 0)
+    close(src_fd);
+  src_fd = -1;
+
+  return(result);
+}
+/************************************************************/
+
+/************************************************************/
+/* offset of the first line that starts in chunk k */
+static size_t chunk_start(long k)
+{
+  size_t pos = (size_t)k * TRACE_CHUNK_SIZE;
+  char *nl;
+
+  if (k == 0)
+    return(0);
+  if (pos >= map_size)
+    return(map_size);
+
+  /* a line belongs to the chunk its first byte falls in */
+  nl = memchr(map_base + pos - 1, '\n', map_size - pos + 1);
+  return(nl ? nl - map_base + 1 : map_size);
+}
+
+static int hex_digit(int c)
+{
+  if (c >= '0' && c <= '9')
+    return(c - '0');
+  if (c >= 'a' && c <= 'f')
+    return(c - 'a' + 10);
+  if (c >= 'A' && c <= 'F')
+    return(c - 'A' + 10);
+  return(-1);
+}
+
+/*
+ * decodes a "<type> <hex addr> ..." line ending at end; returns FALSE
+ * for a blank or malformed line, which both trace readers skip
+ */
+int parse_trace_line(char *p, char *end, unsigned *access_type, unsigned *addr)
+{
+  int d, digits;
+
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    p++;
+
+  *access_type = 0;
+  for (digits = 0; p < end && *p >= '0' && *p <= '9'; digits++)
+    *access_type = *access_type * 10 + (*p++ - '0');
+  if (!digits)
+    return(0);
+
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')
+      && hex_digit(p[2]) >= 0)
+    p += 2;
+
+  *addr = 0;
+  for (digits = 0; p < end && (d = hex_digit(*p)) >= 0; digits++, p++)
+    *addr = (*addr << 4) | d;
+
+  return(digits > 0);
+}
+
+/* decodes one chunk, line by line */
+static void parse_chunk(char *p, char *end, Ptrace_chunk chunk)
+{
+  unsigned type, addr;
+  char *eol;
+
+  chunk->n_recs = 0;
+  for (; p < end; p = eol + 1) {
+    eol = memchr(p, '\n', end - p);
+    if (!eol)
+      eol = end;
+    if (!parse_trace_line(p, eol, &type, &addr))
+      continue;
+
+    if (chunk->n_recs == chunk->max_recs) {
+      chunk->max_recs = chunk->max_recs ? 2 * chunk->max_recs : 1024;
+      chunk->recs = (Ptrace_rec)realloc(chunk->recs,
+					sizeof(trace_rec) * chunk->max_recs);
+      if (!chunk->recs) {
+	printf("error:  out of memory parsing trace\n");
+	exit(-1);
+      }
+    }
+    chunk->recs[chunk->n_recs].access_type = type;
+    chunk->recs[chunk->n_recs].addr = addr;
+    chunk->n_recs++;
+  }
+}
+
+static void *parse_worker(void *arg)
+{
+  Ptrace_chunk chunk;
+  long k;
+
+  for (;;) {
+    pthread_mutex_lock(&chunk_lock);
+    if (stop_workers || next_parse >= n_chunks) {
+      pthread_mutex_unlock(&chunk_lock);
+      break;
+    }
+    k = next_parse++;
+    chunk = &slots[k % n_slots];
+    /* wait for the simulator to finish with chunk k - n_slots; waiting
+       on the slot itself would let a later chunk take it first */
+    while (next_consume + n_slots <= k && !stop_workers)
+      pthread_cond_wait(&chunk_free, &chunk_lock);
+    if (stop_workers) {
+      pthread_mutex_unlock(&chunk_lock);
+      break;
+    }
+    chunk->id = k;
+    chunk->ready = 0;
+    pthread_mutex_unlock(&chunk_lock);
+
+    parse_chunk(map_base + chunk_start(k), map_base + chunk_start(k + 1),
+		chunk);
+
+    pthread_mutex_lock(&chunk_lock);
+    chunk->ready = 1;
+    pthread_cond_broadcast(&chunk_ready);
+    pthread_mutex_unlock(&chunk_lock);
+  }
+
+  return(NULL);
+}
+/************************************************************/
+
+/************************************************************/
+/*
+ * maps a plain text trace and starts n_threads parsers (0 = one per
+ * online processor); returns FALSE if the trace cannot be mapped, in
+ * which case the caller should use open_trace() instead
+ */
+int open_trace_parallel(char *name, int n_threads)
+{
+  struct stat st;
+  int fd, i;
+
+  if (!strcmp(name, TRACE_STDIN))
+    return(0);
+
+  fd = open(name, O_RDONLY);
+  if (fd < 0)
+    return(0);
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return(0);
+  }
+
+  /* compressed traces go through the streaming decoders */
+  src_fd = fd;
+  src_magic_len = src_magic_pos = 0;
+  if (sniff_format() != TRACE_FMT_TEXT) {
+    close(fd);
+    src_fd = -1;
+    return(0);
+  }
+  src_fd = -1;
+
+  map_size = st.st_size;
+  map_base = (char *)mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map_base == MAP_FAILED) {
+    map_base = NULL;
+    return(0);
+  }
+  madvise(map_base, map_size, MADV_SEQUENTIAL);
+
+  if (n_threads <= 0)
+    n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads <= 0)
+    n_threads = 1;
+
+  n_chunks = (map_size + TRACE_CHUNK_SIZE - 1) / TRACE_CHUNK_SIZE;
+  next_parse = next_consume = 0;
+  stop_workers = 0;
+  cur_chunk = NULL;
+
+  n_slots = TRACE_CHUNKS_PER_THREAD * n_threads;
+  slots = (Ptrace_chunk)malloc(sizeof(trace_chunk) * n_slots);
+  memset(slots, 0, sizeof(trace_chunk) * n_slots);
+  for (i = 0; i < n_slots; i++)
+    slots[i].id = -1;
+
+  n_workers = n_threads;
+  workers = (pthread_t *)malloc(sizeof(pthread_t) * n_workers);
+  for (i = 0; i < n_workers; i++)
+    if (pthread_create(&workers[i], NULL, parse_worker, NULL)) {
+      printf("error:  cannot start trace parser thread\n");
+      exit(-1);
+    }
+
+  return(1);
+}
+
+/* returns the next record in trace order, or FALSE at end of trace */
+int read_trace_record(unsigned *access_type, unsigned *addr)
+{
+  while (!cur_chunk || cur_rec == cur_chunk->n_recs) {
+    pthread_mutex_lock(&chunk_lock);
+    if (cur_chunk) {
+      /* hand the slot back to the parsers */
+      cur_chunk->id = -1;
+      cur_chunk = NULL;
+      next_consume++;
+      pthread_cond_broadcast(&chunk_free);
+    }
+    if (next_consume >= n_chunks) {
+      pthread_mutex_unlock(&chunk_lock);
+      return(0);
+    }
+    cur_chunk = &slots[next_consume % n_slots];
+    while (cur_chunk->id != next_consume || !cur_chunk->ready)
+      pthread_cond_wait(&chunk_ready, &chunk_lock);
+    pthread_mutex_unlock(&chunk_lock);
+    cur_rec = 0;
+  }
+
+  *access_type = cur_chunk->recs[cur_rec].access_type;
+  *addr = cur_chunk->recs[cur_rec].addr;
+  cur_rec++;
+  return(1);
+}
+
+void close_trace_parallel()
+{
+  int i;
+
+  pthread_mutex_lock(&chunk_lock);
+  stop_workers = 1;
+  pthread_cond_broadcast(&chunk_free);
+  pthread_mutex_unlock(&chunk_lock);
+
+  for (i = 0; i < n_workers; i++)
+    pthread_join(workers[i], NULL);
+  free(workers);
+
+  for (i = 0; i < n_slots; i++)
+    free(slots[i].recs);
+  free(slots);
+  cur_chunk = NULL;
+
+  munmap(map_base, map_size);
+  map_base = NULL;
+}
+/************************************************************/
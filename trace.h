@@ -0,0 +1,46 @@
+/*
+ * trace.h
+ *
+ * Trace file input
+ */
+
+
+/* trace name that selects standard input */
+#define TRACE_STDIN "-"
+
+/* trace encodings recognized from the leading magic bytes */
+#define TRACE_FMT_TEXT 0
+#define TRACE_FMT_GZIP 1
+#define TRACE_FMT_ZSTD 2
+#define TRACE_FMT_XZ 3
+
+#define TRACE_MAGIC_LEN 6
+#define TRACE_IO_BUF (64 * 1024)
+#define TRACE_LINE_MAX 256		/* longer lines are read in pieces */
+
+/* parallel text loader parameters */
+#define TRACE_CHUNK_SIZE (8 * 1024 * 1024)
+#define TRACE_CHUNKS_PER_THREAD 2
+
+/* decoded trace record */
+typedef struct trace_rec_ {
+  unsigned access_type;
+  unsigned addr;
+} trace_rec, *Ptrace_rec;
+
+/* parsed chunk of a mapped text trace */
+typedef struct trace_chunk_ {
+  long id;			/* chunk number held, or -1 if free */
+  int ready;			/* records have been parsed */
+  Ptrace_rec recs;		/* decoded records, in trace order */
+  int n_recs;			/* number of decoded records */
+  int max_recs;			/* allocated size of recs */
+} trace_chunk, *Ptrace_chunk;
+
+/* function prototypes */
+FILE *open_trace(char *name);
+int close_trace(FILE *inFile);
+int parse_trace_line(char *p, char *end, unsigned *access_type, unsigned *addr);
+int open_trace_parallel(char *name, int n_threads);
+int read_trace_record(unsigned *access_type, unsigned *addr);
+void close_trace_parallel();